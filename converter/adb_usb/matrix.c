@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 #include "adb.h"
 #include "matrix.h"
+#include "keyboard.h"
 #include "report.h"
 #include "host.h"
 #include "led.h"
@@ -512,6 +513,11 @@ static void register_key(uint8_t key)
     uint8_t col, row;
     col = key&0x07;
     row = (key>>3)&0x0F;
+#ifdef KEYBOARD_EVENT_QUEUE
+    if (!(key&0x80) != !!(matrix[row] & (1<<col))) {
+        keyboard_event_post(KEYEVENT(row, col, !(key&0x80)));
+    }
+#endif
     if (key&0x80) {
         matrix[row] &= ~(1<<col);
     } else {
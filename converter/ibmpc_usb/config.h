@@ -32,6 +32,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_ROWS 16  // keycode bit: 6-3
 #define MATRIX_COLS 8   // keycode bit: 2-0
 
+/* pass key events from received codes straight to action instead of finding them in matrix */
+//#define KEYBOARD_EVENT_QUEUE
+
 
 /* key combination for command */
 #define IS_COMMAND() ( \
@@ -25,6 +25,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host.h"
 #include "led.h"
 #include "matrix.h"
+#include "timer.h"
 
 
 static void matrix_make(uint8_t code);
@@ -409,6 +410,9 @@ static void matrix_make(uint8_t code)
 {
     if (!matrix_is_on(ROW(code), COL(code))) {
         matrix[ROW(code)] |= 1<<COL(code);
+#ifdef KEYBOARD_EVENT_QUEUE
+        keyboard_event_post(KEYEVENT(ROW(code), COL(code), true));
+#endif
         is_modified = true;
     }
 }
@@ -418,11 +422,22 @@ static void matrix_break(uint8_t code)
 {
     if (matrix_is_on(ROW(code), COL(code))) {
         matrix[ROW(code)] &= ~(1<<COL(code));
+#ifdef KEYBOARD_EVENT_QUEUE
+        keyboard_event_post(KEYEVENT(ROW(code), COL(code), false));
+#endif
         is_modified = true;
     }
 }
 
 void matrix_clear(void)
 {
+#ifdef KEYBOARD_EVENT_QUEUE
+    // release keys left on
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
+        for (; matrix[i]; matrix[i] &= matrix[i] - 1) {
+            keyboard_event_post(KEYEVENT(i, matrix_row_ctz(matrix[i]), false));
+        }
+    }
+#endif
     for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
 }
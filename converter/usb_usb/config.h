@@ -49,6 +49,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // Note that this also disables power saving and remote wakeup from keyboard completely.
 //#define NO_USB_SUSPEND_LOOP
 
+/* Number of keyboards and hubs to host, each keyboard costs RAM */
+//#define USB_KBD_COUNT   4
+//#define USB_HUB_COUNT   2
+
+/* Send keys not remapped on current layers to host directly, without key events of action engine */
+//#define PASSTHROUGH_ENABLE
+
 /* Mechanical locking support. */
 #define LOCKING_SUPPORT_ENABLE
 #define LOCKING_RESYNC_ENABLE
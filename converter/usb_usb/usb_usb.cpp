@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "usbhid.h"
 #include "hidboot.h"
 #include "parser.h"
+#include "usb_hid.h"
 
 #include "keycode.h"
 #include "util.h"
@@ -34,16 +35,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "host.h"
 #include "keyboard.h"
+#include "action_layer.h"
+#include "action_util.h"
+#include "action_tapping.h"
 
 #include "hook.h"
 #include "suspend.h"
 #include "lufa.h"
+#include "spsc_queue.h"
 
 
 /* KEY CODE to Matrix
  *
  * HID keycode(1 byte):
- * Higher 5 bits indicates ROW and lower 3 bits COL.
+ * Higher 4 bits indicates ROW and lower 4 bits COL.
  *
  *  7 6 5 4 3 2 1 0
  * +---------------+
@@ -56,35 +61,85 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *   : |                |
  *   : |                |
  *  16 +----------------+
+ *
+ * This is same layout as usage bitmap of KBDReportParser, a row is a word of
+ * the bitmap and modifiers(E0-E7) are on row 14.
  */
-#define ROW_MASK 0xF0
-#define COL_MASK 0x0F
-#define CODE(row, col)  (((row) << 4) | (col))
-#define ROW(code)       (((code) & ROW_MASK) >> 4)
-#define COL(code)       ((code) & COL_MASK)
-#define ROW_BITS(code)  (1 << COL(code))
 
 
-// Integrated key state of all keyboards
-static report_keyboard_t keyboard_report;
+// Integrated key state of all keyboards, except keys passed through
+static matrix_row_t matrix[MATRIX_ROWS];
 
 static bool matrix_is_mod =false;
 
 /*
  * USB Host Shield HID keyboards
- * This supports two cascaded hubs and four keyboards
+ * This supports USB_HUB_COUNT cascaded hubs and USB_KBD_COUNT keyboards
  */
+#ifndef USB_KBD_COUNT
+#   define USB_KBD_COUNT    4
+#endif
+#ifndef USB_HUB_COUNT
+#   define USB_HUB_COUNT    2
+#endif
+
 USB usb_host;
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd1(&usb_host);
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd2(&usb_host);
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd3(&usb_host);
-HIDBoot<USB_HID_PROTOCOL_KEYBOARD>    kbd4(&usb_host);
-KBDReportParser kbd_parser1;
-KBDReportParser kbd_parser2;
-KBDReportParser kbd_parser3;
-KBDReportParser kbd_parser4;
-USBHub hub1(&usb_host);
-USBHub hub2(&usb_host);
+
+struct usb_kbd {
+#ifdef USB_HID_REPORT_ENABLE
+    HIDReportKeyboard hid;
+#else
+    HIDBoot<USB_HID_PROTOCOL_KEYBOARD> hid;
+#endif
+    KBDReportParser parser;
+    usb_kbd() : hid(&usb_host) {}
+};
+struct usb_hub {
+    USBHub hub;
+    usb_hub() : hub(&usb_host) {}
+};
+static usb_kbd kbds[USB_KBD_COUNT];
+static usb_hub hubs[USB_HUB_COUNT];
+
+// USB::Task() is running
+static bool in_host_task = false;
+
+/* Key states of keyboards taken when reports come, in order. States taken by
+ * hook_usb_host_delay() while USB::Task() runs are applied one per
+ * matrix_scan() after it returns. */
+#ifndef MATRIX_STATE_QUEUE_SIZE
+#   define MATRIX_STATE_QUEUE_SIZE  4
+#endif
+typedef struct {
+    matrix_row_t row[MATRIX_ROWS];
+} matrix_state_t;
+SPSC_QUEUE(state_queue, matrix_state_t, MATRIX_STATE_QUEUE_SIZE)
+
+static void state_queue_take(void)
+{
+    // changed flags are kept until there is room
+    if (state_queue_full()) return;
+
+    bool changed = false;
+    for (uint8_t i = 0; i < USB_KBD_COUNT; i++) {
+        if (kbds[i].parser.changed) {
+            kbds[i].parser.changed = false;
+            changed = true;
+        }
+    }
+    if (!changed) return;
+
+    // integrate key state bitmaps of all keyboards
+    matrix_state_t state;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        matrix_row_t row = 0;
+        for (uint8_t i = 0; i < USB_KBD_COUNT; i++) {
+            row |= kbds[i].parser.usage[r];
+        }
+        state.row[r] = row;
+    }
+    state_queue_put(state);
+}
 
 
 uint8_t matrix_rows(void) { return MATRIX_ROWS; }
@@ -94,74 +149,138 @@ void matrix_init(void) {
     debug_enable = true;
     // USB Host Shield setup
     usb_host.Init();
-    kbd1.SetReportParser(0, (HIDReportParser*)&kbd_parser1);
-    kbd2.SetReportParser(0, (HIDReportParser*)&kbd_parser2);
-    kbd3.SetReportParser(0, (HIDReportParser*)&kbd_parser3);
-    kbd4.SetReportParser(0, (HIDReportParser*)&kbd_parser4);
+    for (uint8_t i = 0; i < USB_KBD_COUNT; i++) {
+        kbds[i].hid.SetReportParser(0, (HIDReportParser*)&kbds[i].parser);
+    }
 }
 
-static void or_report(report_keyboard_t report) {
-    // integrate reports into keyboard_report
-    keyboard_report.mods |= report.mods;
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(report.keys[i])) {
-            for (uint8_t j = 0; j < KEYBOARD_REPORT_KEYS; j++) {
-                if (! keyboard_report.keys[j]) {
-                    keyboard_report.keys[j] = report.keys[i];
-                    break;
-                }
+#ifdef PASSTHROUGH_ENABLE
+/*
+ * Pass-through
+ *
+ * Key without remapping on current layers is added to and deleted from
+ * keyboard report directly, keyboard_task() doesn't see it. Key goes to
+ * keyboard_task() as usual when it holds other keys or has mods or tapping
+ * in effect, and until all keys held there are released.
+ */
+static matrix_row_t source[MATRIX_ROWS];    // integrated key state of all keyboards
+static matrix_row_t passed[MATRIX_ROWS];    // keys passed through
+static uint16_t engine_time = 0;            // last key change to keyboard_task()
+
+static bool engine_idle(void)
+{
+    // keys go to matrix while suspended so that suspend_wakeup_condition() sees them
+    if (USB_DeviceState != DEVICE_STATE_Configured) return false;
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        if (matrix[r]) return false;
+    }
+    if (get_weak_mods() || get_oneshot_mods()) return false;
+#ifndef NO_ACTION_TAPPING
+    if (timer_elapsed(engine_time) < TAPPING_TERM) return false;
+#endif
+#ifdef COMMAND_ENABLE
+    if (IS_COMMAND()) return false;
+#endif
+    return true;
+}
+
+static bool pass_key(uint8_t code)
+{
+    keyevent_t e;
+    e.key.row = code >> 4;
+    e.key.col = code & 0x0F;
+    e.pressed = true;
+    e.time = timer_read() | 1;  // time should not be 0
+    // ACTION_KEY(code)
+    return layer_switch_get_action(e).code == (uint16_t)(ACT_MODS<<12 | code);
+}
+
+static void passthrough(void)
+{
+    bool send = false;
+
+    // released keys passed through are always deleted here
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        matrix_row_t released = passed[r] & ~source[r];
+        for (; released; released &= released - 1) {
+            uint8_t code = (r << 4) | matrix_row_ctz(released);
+            if (IS_MOD(code)) del_mods(MOD_BIT(code)); else del_key(code);
+            send = true;
+        }
+        passed[r] &= source[r];
+    }
+
+    bool idle = engine_idle();
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        matrix_row_t pressed = source[r] & ~passed[r] & ~matrix[r];
+        // from lowest as keyboard_task() does, rest goes to keyboard_task() once a key does
+        for (; idle && pressed; pressed &= pressed - 1) {
+            uint8_t c = matrix_row_ctz(pressed);
+            uint8_t code = (r << 4) | c;
+            if (!pass_key(code)) {
+                idle = false;
+                break;
             }
+            if (IS_MOD(code)) add_mods(MOD_BIT(code)); else add_key(code);
+            passed[r] |= (matrix_row_t)1 << c;
+            send = true;
+        }
+
+        matrix_row_t row = source[r] & ~passed[r];
+        if (matrix[r] != row) {
+            matrix[r] = row;
+            engine_time = timer_read();
         }
     }
+    if (send && USB_DeviceState == DEVICE_STATE_Configured) send_keyboard_report();
 }
+#endif
 
 uint8_t matrix_scan(void) {
-    static uint16_t last_time_stamp1 = 0;
-    static uint16_t last_time_stamp2 = 0;
-    static uint16_t last_time_stamp3 = 0;
-    static uint16_t last_time_stamp4 = 0;
-
-    // check report came from keyboards
-    if (kbd_parser1.time_stamp != last_time_stamp1 ||
-        kbd_parser2.time_stamp != last_time_stamp2 ||
-        kbd_parser3.time_stamp != last_time_stamp3 ||
-        kbd_parser4.time_stamp != last_time_stamp4) {
-
-        last_time_stamp1 = kbd_parser1.time_stamp;
-        last_time_stamp2 = kbd_parser2.time_stamp;
-        last_time_stamp3 = kbd_parser3.time_stamp;
-        last_time_stamp4 = kbd_parser4.time_stamp;
-
-        // clear and integrate all reports
-        keyboard_report = {};
-        or_report(kbd_parser1.report);
-        or_report(kbd_parser2.report);
-        or_report(kbd_parser3.report);
-        or_report(kbd_parser4.report);
+    // USB::Task() is not reentered
+    if (!in_host_task) {
+        uint16_t timer;
+        timer = timer_read();
+        in_host_task = true;
+        usb_host.Task();
+        in_host_task = false;
+        timer = timer_elapsed(timer);
+        if (timer > 100) {
+            xprintf("host.Task: %d\n", timer);
+        }
+        parser_trace_print();
 
-        matrix_is_mod = true;
-    } else {
-        matrix_is_mod = false;
-    }
+        static uint8_t usb_state = 0;
+        if (usb_state != usb_host.getUsbTaskState()) {
+            usb_state = usb_host.getUsbTaskState();
+            xprintf("usb_state: %02X\n", usb_state);
 
-    uint16_t timer;
-    timer = timer_read();
-    usb_host.Task();
-    timer = timer_elapsed(timer);
-    if (timer > 100) {
-        xprintf("host.Task: %d\n", timer);
+            // restore LED state when keyboard comes up
+            if (usb_state == USB_STATE_RUNNING) {
+                xprintf("speed: %s\n", usb_host.getVbusState()==FSHOST ? "full" : "low");
+                keyboard_set_leds(host_keyboard_leds());
+            }
+        }
     }
 
-    static uint8_t usb_state = 0;
-    if (usb_state != usb_host.getUsbTaskState()) {
-        usb_state = usb_host.getUsbTaskState();
-        xprintf("usb_state: %02X\n", usb_state);
+    // check report came from keyboards, after states queued in delay()
+    state_queue_take();
 
-        // restore LED state when keyboard comes up
-        if (usb_state == USB_STATE_RUNNING) {
-            xprintf("speed: %s\n", usb_host.getVbusState()==FSHOST ? "full" : "low");
-            keyboard_set_leds(host_keyboard_leds());
+    if (!state_queue_empty()) {
+        matrix_state_t state = state_queue_get();
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+#ifdef PASSTHROUGH_ENABLE
+            source[r] = state.row[r];
+#else
+            matrix[r] = state.row[r];
+#endif
         }
+#ifdef PASSTHROUGH_ENABLE
+        passthrough();
+#endif
+        matrix_is_mod = true;
+    } else {
+        matrix_is_mod = false;
     }
     return 1;
 }
@@ -171,46 +290,17 @@ bool matrix_is_modified(void) {
 }
 
 bool matrix_is_on(uint8_t row, uint8_t col) {
-    uint8_t code = CODE(row, col);
-
-    if (IS_MOD(code)) {
-        if (keyboard_report.mods & ROW_BITS(code)) {
-            return true;
-        }
-    }
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (keyboard_report.keys[i] == code) {
-            return true;
-        }
-    }
-    return false;
+    return (matrix[row] & ((matrix_row_t)1<<col));
 }
 
 matrix_row_t matrix_get_row(uint8_t row) {
-    uint16_t row_bits = 0;
-
-    if (IS_MOD(CODE(row, 0)) && keyboard_report.mods) {
-        row_bits |= keyboard_report.mods;
-    }
-
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            if (row == ROW(keyboard_report.keys[i])) {
-                row_bits |= ROW_BITS(keyboard_report.keys[i]);
-            }
-        }
-    }
-    return row_bits;
+    return matrix[row];
 }
 
 uint8_t matrix_key_count(void) {
     uint8_t count = 0;
-
-    count += bitpop(keyboard_report.mods);
-    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
-        if (IS_ANY(keyboard_report.keys[i])) {
-            count++;
-        }
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        count += bitpop16(matrix[r]);
     }
     return count;
 }
@@ -220,10 +310,29 @@ void matrix_print(void) {
 
 void led_set(uint8_t usb_led)
 {
-    if (kbd1.isReady()) kbd1.SetReport(0, 0, 2, 0, 1, &usb_led);
-    if (kbd2.isReady()) kbd2.SetReport(0, 0, 2, 0, 1, &usb_led);
-    if (kbd3.isReady()) kbd3.SetReport(0, 0, 2, 0, 1, &usb_led);
-    if (kbd4.isReady()) kbd4.SetReport(0, 0, 2, 0, 1, &usb_led);
+    for (uint8_t i = 0; i < USB_KBD_COUNT; i++) {
+        if (kbds[i].hid.isReady()) kbds[i].hid.SetReport(0, 0, 2, 0, 1, &usb_led);
+    }
+}
+
+// USB::Task() can take hundreds of milliseconds to enumerate a device, mostly
+// waiting in delay(). Keyboards already running are polled once a millisecond
+// meanwhile and their key states are queued, matrix_scan() applies them after
+// Task() returns. Keyboards are not polled while the queue is full, they hold
+// their reports. Actions and LUFA task are not run from here as this is in the
+// middle of matrix_scan() of keyboard_task() and of enumeration.
+void hook_usb_host_delay(void)
+{
+    static uint16_t last = 0;
+    if (!in_host_task || state_queue_full()) return;
+    if (timer_read() == last) return;
+    last = timer_read();
+
+    // Poll() does transfer between those of enumeration
+    for (uint8_t i = 0; i < USB_KBD_COUNT; i++) {
+        if (kbds[i].hid.isReady()) kbds[i].hid.Poll();
+    }
+    state_queue_take();
 }
 
 // We need to keep doing UHS2 USB::Task() to initialize keyboard
@@ -31,6 +31,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MATRIX_ROWS 8
 #define MATRIX_COLS 8
 
+/* matrix pins for MATRIX_PINS_ENABLE
+ * row: D0  D1  D2  D3  D4  D5  D6  C2
+ * col: B0  B1  B2  B3  B4  B5  B6  B7
+ */
+#define MATRIX_ROW_PINS { MATRIX_PIN(D, 0), MATRIX_PIN(D, 1), MATRIX_PIN(D, 2), MATRIX_PIN(D, 3), \
+                          MATRIX_PIN(D, 4), MATRIX_PIN(D, 5), MATRIX_PIN(D, 6), MATRIX_PIN(C, 2) }
+#define MATRIX_COL_PINS { MATRIX_PIN(B, 0), MATRIX_PIN(B, 1), MATRIX_PIN(B, 2), MATRIX_PIN(B, 3), \
+                          MATRIX_PIN(B, 4), MATRIX_PIN(B, 5), MATRIX_PIN(B, 6), MATRIX_PIN(B, 7) }
+/* delay for settling after selecting row(us) */
+#define MATRIX_IO_DELAY 30
+
 /* define if matrix has ghost */
 //#define MATRIX_HAS_GHOST
 
@@ -16,8 +16,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <avr/io.h>
+#include <util/delay.h>
 #include "stdint.h"
 #include "led.h"
+#include "hook.h"
 
 
 void led_set(uint8_t usb_led)
@@ -32,3 +34,11 @@ void led_set(uint8_t usb_led)
         PORTC &= ~(1<<5);
     }
 }
+
+/* blink LED at startup */
+void hook_early_init(void)
+{
+    DDRC |= (1<<5); PORTC |= (1<<5);
+    _delay_ms(500);
+    DDRC &= ~(1<<5); PORTC &= ~(1<<5);
+}
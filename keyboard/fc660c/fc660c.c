@@ -60,6 +60,52 @@ void matrix_init(void)
     matrix_prev = _matrix1;
 }
 
+/* Sense a key selected with SET_COL() and SET_ROW()
+ * Returns 1 when on, 0 when off and -1 when sensing was interrupted and
+ * its state is not valid.
+ */
+static int8_t sense_key(bool prev_on)
+{
+    int8_t on;
+
+    _delay_us(2);
+
+    // Not sure this is needed. This just emulates HHKB controller's behaviour.
+    if (prev_on) {
+        KEY_HYS_ON();
+    }
+    _delay_us(10);
+
+    // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
+    // If V-USB interrupts in this section we could lose 40us or so
+    // and would read invalid value from KEY_STATE.
+    uint8_t last = TIMER_RAW;
+
+    KEY_ENABLE();
+
+    // Wait for KEY_STATE outputs its value.
+    _delay_us(2);
+
+    on = KEY_STATE() ? 0 : 1;
+
+    // Ignore if this code region execution time elapses more than 20us.
+    // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
+    // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
+    if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
+        on = -1;
+    }
+
+    _delay_us(5);
+    KEY_HYS_OFF();
+    KEY_UNABLE();
+    return on;
+}
+
+// NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
+// This takes 25us or more to make sure KEY_STATE returns to idle state.
+#define KEY_RECOVERY_US     75
+
+#ifndef MATRIX_SCAN_SLICE
 uint8_t matrix_scan(void)
 {
     matrix_row_t *tmp;
@@ -74,51 +120,92 @@ uint8_t matrix_scan(void)
         for (row = 0; row < MATRIX_ROWS; row++) {
             //KEY_SELECT(row, col);
             SET_ROW(row);
-            _delay_us(2);
-
-            // Not sure this is needed. This just emulates HHKB controller's behaviour.
-            if (matrix_prev[row] & (1<<col)) {
-                KEY_HYS_ON();
+            switch (sense_key(matrix_prev[row] & (1<<col))) {
+                case 1:  matrix[row] |=  (1<<col); break;
+                case 0:  matrix[row] &= ~(1<<col); break;
+                default: matrix[row] = matrix_prev[row]; break;
             }
-            _delay_us(10);
+            _delay_us(KEY_RECOVERY_US);
+        }
+        if (matrix[row] ^ matrix_prev[row]) {
+            matrix_last_modified = timer_read32();
+        }
+    }
+    return 1;
+}
+#else
+/*
+ * Sliced scan
+ * Senses MATRIX_SCAN_SLICE keys at most per call and next call resumes from
+ * there. Recovery time after the last key of a slice is not waited with delay
+ * but checked with timer count on next call, main loop runs meanwhile. A
+ * column is published to matrix as soon as all its keys are sensed.
+ */
+#define KEY_RECOVERY_RAW    ((KEY_RECOVERY_US * (TIMER_RAW_FREQ / 1000) + 999) / 1000)
 
-            // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
-            // If V-USB interrupts in this section we could lose 40us or so
-            // and would read invalid value from KEY_STATE.
-            uint8_t last = TIMER_RAW;
+static uint8_t scan_row = 0;
+static uint8_t scan_col = 0;
+static uint8_t scan_data = 0;   /* bit per row of column being sensed */
+static bool recovering = false;
+static uint8_t recovery_raw;
+static uint16_t recovery_ms;
 
-            KEY_ENABLE();
+static bool key_recovered(void)
+{
+    if (!recovering) return true;
 
-            // Wait for KEY_STATE outputs its value.
-            _delay_us(2);
+    // Timer0 counts up to TIMER_RAW_TOP and wraps every 1ms
+    uint8_t now = TIMER_RAW;
+    uint8_t elapsed = (now >= recovery_raw) ? (now - recovery_raw) : (now + TIMER_RAW_TOP + 1 - recovery_raw);
+    if (elapsed >= KEY_RECOVERY_RAW || timer_elapsed(recovery_ms) > 1) {
+        recovering = false;
+    }
+    return !recovering;
+}
 
-            if (KEY_STATE()) {
-                matrix[row] &= ~(1<<col);
-            } else {
-                matrix[row] |= (1<<col);
-            }
+uint8_t matrix_scan(void)
+{
+    uint8_t changed = 0;
 
-            // Ignore if this code region execution time elapses more than 20us.
-            // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
-            // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
-            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
-                matrix[row] = matrix_prev[row];
-            }
+    if (!key_recovered()) return 0;
 
-            _delay_us(5);
-            KEY_HYS_OFF();
-            KEY_UNABLE();
+    for (uint8_t n = 0; n < MATRIX_SCAN_SLICE; n++) {
+        if (n) _delay_us(KEY_RECOVERY_US);
 
-            // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
-            // This takes 25us or more to make sure KEY_STATE returns to idle state.
-            _delay_us(75);
+        SET_COL(scan_col);
+        SET_ROW(scan_row);
+        matrix_row_t col_mask = ((matrix_row_t)1<<scan_col);
+        int8_t on = sense_key(matrix[scan_row] & col_mask);
+        if (on < 0) {
+            // keep previous state
+            on = (matrix[scan_row] & col_mask) ? 1 : 0;
         }
-        if (matrix[row] ^ matrix_prev[row]) {
-            matrix_last_modified = timer_read32();
+        if (on) scan_data |= (1<<scan_row);
+
+        if (++scan_row < MATRIX_ROWS) continue;
+
+        // publish column
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            matrix_row_t r = (scan_data & (1<<row)) ? (matrix[row] | col_mask) : (matrix[row] & ~col_mask);
+            if (matrix[row] != r) {
+                matrix[row] = r;
+                changed = 1;
+            }
+        }
+        if (changed) matrix_last_modified = timer_read32();
+        scan_data = 0;
+        scan_row = 0;
+        if (++scan_col >= MATRIX_COLS) {
+            scan_col = 0;
+            break;
         }
     }
-    return 1;
+    recovering = true;
+    recovery_raw = TIMER_RAW;
+    recovery_ms = timer_read();
+    return changed;
 }
+#endif
 
 inline
 matrix_row_t matrix_get_row(uint8_t row)
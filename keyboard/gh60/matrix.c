@@ -27,18 +27,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "timer.h"
 #include "matrix.h"
+#include "debounce.h"
 
 
-#ifndef DEBOUNCE
-#   define DEBOUNCE	5
-#endif
-static bool debouncing = false;
-static uint16_t debouncing_time = 0;
-
 
 /* matrix state(1:on, 0:off) */
 static matrix_row_t matrix[MATRIX_ROWS];
-static matrix_row_t matrix_debouncing[MATRIX_ROWS];
 
 static matrix_row_t read_cols(void);
 static void init_cols(void);
@@ -55,8 +49,8 @@ void matrix_init(void)
     // initialize matrix state: all keys off
     for (uint8_t i=0; i < MATRIX_ROWS; i++) {
         matrix[i] = 0;
-        matrix_debouncing[i] = 0;
     }
+    debounce_init(matrix);
 }
 
 uint8_t matrix_scan(void)
@@ -64,26 +58,11 @@ uint8_t matrix_scan(void)
     for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
         select_row(i);
         _delay_us(1);  // delay for settling
-        matrix_row_t cols = read_cols();
-        if (matrix_debouncing[i] != cols) {
-            if (debouncing) {
-                dprintf("bounce: %d %d@%02X\n", timer_elapsed(debouncing_time), i, matrix_debouncing[i]^cols);
-            }
-            matrix_debouncing[i] = cols;
-            debouncing = true;
-            debouncing_time = timer_read();
-        }
+        debounce_row(i, read_cols());
         unselect_rows();
     }
 
-    if (debouncing && timer_elapsed(debouncing_time) >= DEBOUNCE) {
-        for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-            matrix[i] = matrix_debouncing[i];
-        }
-        debouncing = false;
-    }
-
-    return 1;
+    return debounce_update();
 }
 
 inline
@@ -35,6 +35,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 #define MATRIX_COLS 8
 
+/* sense this number of keys per matrix_scan() and let main loop run between slices */
+//#define MATRIX_SCAN_SLICE   8
+
+/* measure recovery time with Esc held alone at startup and store it in EEPROM */
+//#define TOPRE_CALIBRATE
+/* key to hold for calibration: row<<4 | col */
+//#define TOPRE_CALIBRATE_KEY 0x31
+
 
 /* key combination for command */
 #define IS_COMMAND() (keyboard_report->mods == (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))) 
@@ -42,6 +42,53 @@ static matrix_row_t *matrix_prev;
 static matrix_row_t _matrix0[MATRIX_ROWS];
 static matrix_row_t _matrix1[MATRIX_ROWS];
 
+// Wait for KEY_STATE outputs its value after KEY_ENABLE.
+#define KEY_SETTLE_US       5
+
+// NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
+// This takes 25us or more to make sure KEY_STATE returns to idle state.
+#ifdef HHKB_JP
+// Looks like JP needs faster scan due to its twice larger matrix
+// or it can drop keys in fast key typing
+#   define KEY_RECOVERY_US  30
+#else
+#   define KEY_RECOVERY_US  75
+#endif
+
+#ifdef TOPRE_CALIBRATE
+/*
+ * Recovery time calibration
+ * Recovery time of KEY_STATE is measured with TIMER_RAW while
+ * TOPRE_CALIBRATE_KEY is held alone at startup and stored in EEPROM, it is
+ * used instead of the default. Settle time is a few microseconds, shorter
+ * than a tick of TIMER_RAW(4us at 16MHz), and is not calibrated.
+ */
+#include <avr/eeprom.h>
+#define CALIB_EEPROM_MAGIC      (uint8_t *)120
+#define CALIB_EEPROM_RECOVERY   (uint8_t *)121
+#define CALIB_MAGIC             0xC6
+
+/* key held alone at startup to calibrate: row<<4 | col, Esc by default */
+#ifndef TOPRE_CALIBRATE_KEY
+#   ifdef HHKB_JP
+#       define TOPRE_CALIBRATE_KEY  0x02
+#   else
+#       define TOPRE_CALIBRATE_KEY  0x31
+#   endif
+#endif
+
+static uint8_t key_recovery_us = KEY_RECOVERY_US;
+static void calibration_init(void);
+
+static void delay_us(uint8_t us)
+{
+    while (us--) _delay_us(1);
+}
+#   define KEY_RECOVERY_DELAY()     delay_us(key_recovery_us)
+#else
+#   define KEY_RECOVERY_DELAY()     _delay_us(KEY_RECOVERY_US)
+#endif
+
 
 void matrix_init(void)
 {
@@ -57,8 +104,76 @@ void matrix_init(void)
     for (uint8_t i=0; i < MATRIX_ROWS; i++) _matrix1[i] = 0x00;
     matrix = _matrix0;
     matrix_prev = _matrix1;
+
+#ifdef TOPRE_CALIBRATE
+    calibration_init();
+#endif
+}
+
+/* Sense a key selected with KEY_SELECT()
+ * Returns 1 when on, 0 when off and -1 when sensing was interrupted and
+ * its state is not valid.
+ */
+static int8_t sense_key(bool prev_on)
+{
+    int8_t on;
+
+    _delay_us(5);
+
+    // Not sure this is needed. This just emulates HHKB controller's behaviour.
+    if (prev_on) {
+        KEY_PREV_ON();
+    }
+    _delay_us(10);
+
+    // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
+    // If V-USB interrupts in this section we could lose 40us or so
+    // and would read invalid value from KEY_STATE.
+    uint8_t last = TIMER_RAW;
+
+    KEY_ENABLE();
+
+    // Wait for KEY_STATE outputs its value.
+    // 1us was ok on one HHKB, but not worked on another.
+    // no   wait doesn't work on Teensy++ with pro(1us works)
+    // no   wait does    work on tmk PCB(8MHz) with pro2
+    // 1us  wait does    work on both of above
+    // 1us  wait doesn't work on tmk(16MHz)
+    // 5us  wait does    work on tmk(16MHz)
+    // 5us  wait does    work on tmk(16MHz/2)
+    // 5us  wait does    work on tmk(8MHz)
+    // 10us wait does    work on Teensy++ with pro
+    // 10us wait does    work on 328p+iwrap with pro
+    // 10us wait doesn't work on tmk PCB(8MHz) with pro2(very lagged scan)
+    _delay_us(KEY_SETTLE_US);
+
+    on = KEY_STATE() ? 0 : 1;
+
+    // Ignore if this code region execution time elapses more than 20us.
+    // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
+    // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
+    if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
+        on = -1;
+    }
+
+    _delay_us(5);
+    KEY_PREV_OFF();
+    KEY_UNABLE();
+    return on;
 }
 
+static void power_save(void)
+{
+    if (KEY_POWER_STATE() &&
+            (USB_DeviceState == DEVICE_STATE_Suspended ||
+             USB_DeviceState == DEVICE_STATE_Unattached ) &&
+            timer_elapsed32(matrix_last_modified) > MATRIX_POWER_SAVE) {
+        KEY_POWER_OFF();
+        suspend_power_down();
+    }
+}
+
+#ifndef MATRIX_SCAN_SLICE
 uint8_t matrix_scan(void)
 {
     uint8_t *tmp;
@@ -72,74 +187,184 @@ uint8_t matrix_scan(void)
     for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
         for (uint8_t col = 0; col < MATRIX_COLS; col++) {
             KEY_SELECT(row, col);
-            _delay_us(5);
-
-            // Not sure this is needed. This just emulates HHKB controller's behaviour.
-            if (matrix_prev[row] & (1<<col)) {
-                KEY_PREV_ON();
-            }
-            _delay_us(10);
-
-            // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
-            // If V-USB interrupts in this section we could lose 40us or so
-            // and would read invalid value from KEY_STATE.
-            uint8_t last = TIMER_RAW;
-
-            KEY_ENABLE();
-
-            // Wait for KEY_STATE outputs its value.
-            // 1us was ok on one HHKB, but not worked on another.
-            // no   wait doesn't work on Teensy++ with pro(1us works)
-            // no   wait does    work on tmk PCB(8MHz) with pro2
-            // 1us  wait does    work on both of above
-            // 1us  wait doesn't work on tmk(16MHz)
-            // 5us  wait does    work on tmk(16MHz)
-            // 5us  wait does    work on tmk(16MHz/2)
-            // 5us  wait does    work on tmk(8MHz)
-            // 10us wait does    work on Teensy++ with pro
-            // 10us wait does    work on 328p+iwrap with pro
-            // 10us wait doesn't work on tmk PCB(8MHz) with pro2(very lagged scan)
-            _delay_us(5);
-
-            if (KEY_STATE()) {
-                matrix[row] &= ~(1<<col);
-            } else {
-                matrix[row] |= (1<<col);
+            switch (sense_key(matrix_prev[row] & (1<<col))) {
+                case 1:  matrix[row] |=  (1<<col); break;
+                case 0:  matrix[row] &= ~(1<<col); break;
+                default: matrix[row] = matrix_prev[row]; break;
             }
+            KEY_RECOVERY_DELAY();
+        }
+        if (matrix[row] ^ matrix_prev[row]) matrix_last_modified = timer_read32();
+    }
+    // power off
+    power_save();
+    return 1;
+}
+#else
+/*
+ * Sliced scan
+ * Senses MATRIX_SCAN_SLICE keys at most per call and next call resumes from
+ * there. Recovery time after the last key of a slice is not waited with delay
+ * but checked with timer count on next call, main loop runs meanwhile. A row
+ * is published to matrix as soon as all its keys are sensed.
+ */
+#define US_TO_RAW(us)       (((uint16_t)(us) * (TIMER_RAW_FREQ / 1000) + 999) / 1000)
+#ifdef TOPRE_CALIBRATE
+#   define KEY_RECOVERY_RAW key_recovery_raw
+static uint8_t key_recovery_raw = US_TO_RAW(KEY_RECOVERY_US);
+#else
+#   define KEY_RECOVERY_RAW US_TO_RAW(KEY_RECOVERY_US)
+#endif
 
-            // Ignore if this code region execution time elapses more than 20us.
-            // MEMO: 20[us] * (TIMER_RAW_FREQ / 1000000)[count per us]
-            // MEMO: then change above using this rule: a/(b/c) = a*1/(b/c) = a*(c/b)
-            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
-                matrix[row] = matrix_prev[row];
-            }
+static uint8_t scan_row = 0;
+static uint8_t scan_col = 0;
+static matrix_row_t scan_data = 0;
+static bool recovering = false;
+static uint8_t recovery_raw;
+static uint16_t recovery_ms;
 
-            _delay_us(5);
-            KEY_PREV_OFF();
-            KEY_UNABLE();
+static bool key_recovered(void)
+{
+    if (!recovering) return true;
 
-            // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
-            // This takes 25us or more to make sure KEY_STATE returns to idle state.
-#ifdef HHKB_JP
-            // Looks like JP needs faster scan due to its twice larger matrix
-            // or it can drop keys in fast key typing
-            _delay_us(30);
-#else
-            _delay_us(75);
+    // Timer0 counts up to TIMER_RAW_TOP and wraps every 1ms
+    uint8_t now = TIMER_RAW;
+    uint8_t elapsed = (now >= recovery_raw) ? (now - recovery_raw) : (now + TIMER_RAW_TOP + 1 - recovery_raw);
+    if (elapsed >= KEY_RECOVERY_RAW || timer_elapsed(recovery_ms) > 1) {
+        recovering = false;
+    }
+    return !recovering;
+}
+
+uint8_t matrix_scan(void)
+{
+    uint8_t changed = 0;
+
+    if (!key_recovered()) return 0;
+
+    // power on
+    if (!KEY_POWER_STATE()) KEY_POWER_ON();
+    for (uint8_t n = 0; n < MATRIX_SCAN_SLICE; n++) {
+        if (n) KEY_RECOVERY_DELAY();
+
+        KEY_SELECT(scan_row, scan_col);
+        int8_t on = sense_key(matrix[scan_row] & (1<<scan_col));
+        if (on < 0) {
+            // keep previous state
+            on = (matrix[scan_row] & (1<<scan_col)) ? 1 : 0;
+        }
+        if (on) scan_data |= (1<<scan_col);
+
+        if (++scan_col < MATRIX_COLS) continue;
+
+        // publish row
+        if (matrix[scan_row] != scan_data) {
+            matrix[scan_row] = scan_data;
+            matrix_last_modified = timer_read32();
+            changed = 1;
+        }
+        scan_data = 0;
+        scan_col = 0;
+        if (++scan_row >= MATRIX_ROWS) {
+            scan_row = 0;
+            power_save();
+            break;
+        }
+    }
+    recovering = true;
+    recovery_raw = TIMER_RAW;
+    recovery_ms = timer_read();
+    return changed;
+}
 #endif
+
+#ifdef TOPRE_CALIBRATE
+#define CALIB_SAMPLES       32
+#define CALIB_TIMEOUT_RAW   (TIMER_RAW_FREQ / 5000)     // 200us
+#define RAW_TO_US(raw)      ((uint16_t)(raw) * 1000 / (TIMER_RAW_FREQ / 1000))
+
+/* TIMER_RAW counts since start, Timer0 counts up to TIMER_RAW_TOP and wraps every 1ms */
+static uint8_t raw_since(uint8_t start)
+{
+    uint8_t now = TIMER_RAW;
+    return (now >= start) ? (now - start) : (now + TIMER_RAW_TOP + 1 - start);
+}
+
+/* Measure recovery time in TIMER_RAW counts on a key held down */
+static bool calibrate_key(uint8_t row, uint8_t col, uint8_t *recovery)
+{
+    bool ok = true;
+
+    KEY_SELECT(row, col);
+    _delay_us(5);
+    KEY_PREV_ON();
+    _delay_us(10);
+
+    cli();
+    KEY_ENABLE();
+    _delay_us(KEY_SETTLE_US);
+    if (KEY_STATE()) ok = false;    // key is not on
+    _delay_us(5);
+    KEY_PREV_OFF();
+    KEY_UNABLE();
+    // time until KEY_STATE returns to idle(high), start is up to a count late
+    uint8_t start = TIMER_RAW;
+    while (!KEY_STATE() && raw_since(start) <= CALIB_TIMEOUT_RAW) ;
+    uint8_t r = raw_since(start) + 1;
+    sei();
+
+    _delay_us(KEY_RECOVERY_US);
+    if (!ok || r > CALIB_TIMEOUT_RAW) return false;
+    if (r > *recovery) *recovery = r;
+    return true;
+}
+
+static void calibration_init(void)
+{
+    // run only with TOPRE_CALIBRATE_KEY held alone, not on bootmagic combination
+    if (!KEY_POWER_STATE()) KEY_POWER_ON();
+    uint8_t held = 0;
+    bool trigger = false;
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            KEY_SELECT(row, col);
+            int8_t on = sense_key(false);
+            _delay_us(KEY_RECOVERY_US);
+            if (on != 1) continue;
+            held++;
+            if ((row<<4 | col) == TOPRE_CALIBRATE_KEY) trigger = true;
         }
-        if (matrix[row] ^ matrix_prev[row]) matrix_last_modified = timer_read32();
     }
-    // power off
-    if (KEY_POWER_STATE() &&
-            (USB_DeviceState == DEVICE_STATE_Suspended ||
-             USB_DeviceState == DEVICE_STATE_Unattached ) &&
-            timer_elapsed32(matrix_last_modified) > MATRIX_POWER_SAVE) {
-        KEY_POWER_OFF();
-        suspend_power_down();
+
+    if (held == 1 && trigger) {
+        uint8_t recovery = 0;
+        uint8_t i;
+        for (i = 0; i < CALIB_SAMPLES; i++) {
+            if (!calibrate_key(TOPRE_CALIBRATE_KEY>>4, TOPRE_CALIBRATE_KEY & 0x0F, &recovery)) break;
+        }
+        if (i == CALIB_SAMPLES) {
+            // keep margin: add half to recovery
+            uint16_t us = RAW_TO_US(recovery);
+            us = us + us / 2 + 5;
+            key_recovery_us = (us > 255 ? 255 : us);
+            eeprom_update_byte(CALIB_EEPROM_RECOVERY, key_recovery_us);
+            eeprom_update_byte(CALIB_EEPROM_MAGIC, CALIB_MAGIC);
+        } else {
+            dprintf("calib: failed\n");
+        }
     }
-    return 1;
+
+    if (eeprom_read_byte(CALIB_EEPROM_MAGIC) == CALIB_MAGIC) {
+        key_recovery_us = eeprom_read_byte(CALIB_EEPROM_RECOVERY);
+    } else {
+        key_recovery_us = KEY_RECOVERY_US;
+    }
+#ifdef MATRIX_SCAN_SLICE
+    key_recovery_raw = US_TO_RAW(key_recovery_us);
+#endif
+    dprintf("calib: recovery:%dus\n", key_recovery_us);
 }
+#endif
 
 inline
 matrix_row_t matrix_get_row(uint8_t row)
@@ -40,6 +40,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* Set 0 if debouncing isn't needed */
 #define DEBOUNCE    5
 
+/* scan matrix with timer interrupt instead of busy-wait loop, see matrix.c */
+//#define MATRIX_TIMER_SCAN
+//#define MATRIX_TIMER_SCAN_ROW_US 20
+//#define MATRIX_TIMER_SCAN_PERIOD_US 1000
+#ifdef MATRIX_TIMER_SCAN
+#   define HAL_USE_GPT TRUE
+#endif
+
 /* Mechanical locking support. Use KC_LCAP, KC_LNUM or KC_LSCR instead in keymap */
 //#define LOCKING_SUPPORT_ENABLE
 /* Locking resynchronize hack */
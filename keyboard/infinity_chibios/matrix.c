@@ -6,6 +6,7 @@
 #include "wait.h"
 #include "print.h"
 #include "matrix.h"
+#include "debounce.h"
 
 
 /*
@@ -18,9 +19,73 @@
  */
 /* matrix state(1:on, 0:off) */
 static matrix_row_t matrix[MATRIX_ROWS];
-static matrix_row_t matrix_debouncing[MATRIX_ROWS];
-static bool debouncing = false;
-static uint16_t debouncing_time = 0;
+
+#ifdef MATRIX_TIMER_SCAN
+/*
+ * Timer driven scan:
+ * Timer interrupt reads columns of the row strobed at previous tick and
+ * strobes next row, so pin settle time is covered by timer period instead of
+ * wait_us(). Rows are captured into a frame buffer and matrix_scan() only
+ * debounces the latest finished frame. After last row timer idles until next
+ * frame so that interrupt load is MATRIX_ROWS ticks per frame period.
+ */
+#ifndef MATRIX_TIMER_SCAN_ROW_US
+#   define MATRIX_TIMER_SCAN_ROW_US 20
+#endif
+#ifndef MATRIX_TIMER_SCAN_PERIOD_US
+#   define MATRIX_TIMER_SCAN_PERIOD_US 1000
+#endif
+#if MATRIX_TIMER_SCAN_PERIOD_US <= MATRIX_TIMER_SCAN_ROW_US * MATRIX_ROWS
+#   error "MATRIX_TIMER_SCAN_PERIOD_US must be longer than MATRIX_TIMER_SCAN_ROW_US * MATRIX_ROWS"
+#endif
+#define MATRIX_TIMER_SCAN_IDLE_US   (MATRIX_TIMER_SCAN_PERIOD_US - MATRIX_TIMER_SCAN_ROW_US * MATRIX_ROWS)
+
+static const struct {
+    ioportid_t port;
+    uint8_t    pad;
+} row_pins[MATRIX_ROWS] = {
+    { GPIOB, 0 }, { GPIOB, 1 }, { GPIOB, 2 }, { GPIOB, 3 }, { GPIOB, 16 },
+    { GPIOB, 17 }, { GPIOC, 4 }, { GPIOC, 5 }, { GPIOD, 0 }
+};
+
+/* frame being filled by timer and the last finished one */
+static matrix_row_t frame[2][MATRIX_ROWS];
+static uint8_t frame_fill = 0;
+static volatile bool frame_ready = false;
+/* row strobed, MATRIX_ROWS while idling between frames */
+static uint8_t scan_row = 0;
+
+static void matrix_timer_cb(GPTDriver *gptp)
+{
+    gptcnt_t next = MATRIX_TIMER_SCAN_ROW_US;
+
+    if (scan_row < MATRIX_ROWS) {
+        // read col data of row strobed at previous tick
+        frame[frame_fill][scan_row] = (palReadPort(GPIOD)>>1);
+        palClearPad(row_pins[scan_row].port, row_pins[scan_row].pad);
+
+        if (++scan_row >= MATRIX_ROWS) {
+            frame_fill ^= 1;
+            frame_ready = true;
+            next = MATRIX_TIMER_SCAN_IDLE_US;
+        }
+    } else {
+        scan_row = 0;
+    }
+    if (scan_row < MATRIX_ROWS) {
+        palSetPad(row_pins[scan_row].port, row_pins[scan_row].pad);
+    }
+
+    chSysLockFromISR();
+    gptStartOneShotI(gptp, next);
+    chSysUnlockFromISR();
+}
+
+static const GPTConfig matrix_gpt_config = {
+    1000000,            /* 1MHz timer clock */
+    matrix_timer_cb
+};
+#endif
 
 
 void matrix_init(void)
@@ -46,9 +111,36 @@ void matrix_init(void)
     palSetPadMode(GPIOD, 0,  PAL_MODE_OUTPUT_PUSHPULL);
 
     memset(matrix, 0, MATRIX_ROWS);
-    memset(matrix_debouncing, 0, MATRIX_ROWS);
+    debounce_init(matrix);
+
+#ifdef MATRIX_TIMER_SCAN
+    palSetPad(row_pins[0].port, row_pins[0].pad);
+    gptStart(&GPTD1, &matrix_gpt_config);
+    gptStartOneShot(&GPTD1, MATRIX_TIMER_SCAN_ROW_US);
+#endif
 }
 
+#ifdef MATRIX_TIMER_SCAN
+uint8_t matrix_scan(void)
+{
+    if (frame_ready) {
+        matrix_row_t data[MATRIX_ROWS];
+
+        // copy finished frame, timer doesn't swap it while locked
+        chSysLock();
+        memcpy(data, frame[frame_fill ^ 1], sizeof(data));
+        frame_ready = false;
+        chSysUnlock();
+
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            debounce_row(row, data[row]);
+        }
+    }
+
+    return debounce_update();
+}
+#else
+
 uint8_t matrix_scan(void)
 {
     for (int row = 0; row < MATRIX_ROWS; row++) {
@@ -85,21 +177,12 @@ uint8_t matrix_scan(void)
             case 8: palClearPad(GPIOD, 0);    break;
         }
 
-        if (matrix_debouncing[row] != data) {
-            matrix_debouncing[row] = data;
-            debouncing = true;
-            debouncing_time = timer_read();
-        }
+        debounce_row(row, data);
     }
 
-    if (debouncing && timer_elapsed(debouncing_time) > DEBOUNCE) {
-        for (int row = 0; row < MATRIX_ROWS; row++) {
-            matrix[row] = matrix_debouncing[row];
-        }
-        debouncing = false;
-    }
-    return 1;
+    return debounce_update();
 }
+#endif
 
 bool matrix_is_on(uint8_t row, uint8_t col)
 {
@@ -52,4 +52,8 @@
  * for Teensy 3.x */
 #define KINETIS_USB_USB0_IRQ_PRIORITY       2
 
+#ifdef MATRIX_TIMER_SCAN
+#define KINETIS_GPT_USE_PIT0                TRUE
+#endif
+
 #endif /* _MCUCONF_H_ */
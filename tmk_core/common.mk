@@ -2,6 +2,7 @@ COMMON_DIR = common
 SRC +=	$(COMMON_DIR)/host.c \
 	$(COMMON_DIR)/keyboard.c \
 	$(COMMON_DIR)/matrix.c \
+	$(COMMON_DIR)/debounce.c \
 	$(COMMON_DIR)/action.c \
 	$(COMMON_DIR)/action_tapping.c \
 	$(COMMON_DIR)/action_macro.c \
@@ -89,6 +90,10 @@ ifeq (yes,$(strip $(SLEEP_LED_ENABLE)))
     OPT_DEFS += -DNO_SUSPEND_POWER_DOWN
 endif
 
+ifeq (yes,$(strip $(MATRIX_PINS_ENABLE)))
+    SRC += $(COMMON_DIR)/avr/matrix_pins.c
+endif
+
 ifeq (yes,$(strip $(BACKLIGHT_ENABLE)))
     SRC += $(COMMON_DIR)/backlight.c
     OPT_DEFS += -DBACKLIGHT_ENABLE
@@ -168,6 +168,7 @@ void process_action(keyrecord_t *record)
                                     if (action.key.code == KC_CAPSLOCK ||
                                             action.key.code == KC_NUMLOCK ||
                                             action.key.code == KC_SCROLLLOCK) {
+                                        flush_keyboard_report();
                                         wait_ms(100);
                                     }
                                 }
@@ -306,6 +307,7 @@ void process_action(keyrecord_t *record)
                             if (action.layer_tap.code == KC_CAPSLOCK ||
                                     action.layer_tap.code == KC_NUMLOCK ||
                                     action.layer_tap.code == KC_SCROLLLOCK) {
+                                flush_keyboard_report();
                                 wait_ms(100);
                             }
                         } else {
@@ -360,6 +362,7 @@ void process_action(keyrecord_t *record)
                 case COMMAND_BOOTLOADER:
                     if (event.pressed) {
                         clear_keyboard();
+                        flush_keyboard_report();
                         wait_ms(50);
                         bootloader_jump();
                     }
@@ -409,6 +412,7 @@ void register_code(uint8_t code)
 #endif
         add_key(c);
         send_keyboard_report();
+        flush_keyboard_report();
         wait_ms(100); // Delay for MacOS #390
         del_key(c);
         send_keyboard_report();
@@ -478,6 +482,7 @@ void unregister_code(uint8_t code)
 #endif
         add_key(c);
         send_keyboard_report();
+        flush_keyboard_report();
         wait_ms(100); // Delay for MacOS #390
         del_key(c);
         send_keyboard_report();
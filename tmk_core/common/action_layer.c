@@ -2,6 +2,7 @@
 #include "keyboard.h"
 #include "action.h"
 #include "util.h"
+#include "matrix.h"
 #include "action_layer.h"
 #include "hook.h"
 
@@ -12,6 +13,13 @@
 #endif
 
 
+#if defined(LAYER_CACHE_ENABLE) && !defined(NO_ACTION_LAYER)
+static void layer_cache_clear(void);
+#else
+#define layer_cache_clear()
+#endif
+
+
 /* 
  * Default Layer State
  */
@@ -22,6 +30,7 @@ static void default_layer_state_set(uint32_t state)
     debug("default_layer_state: ");
     default_layer_debug(); debug(" to ");
     default_layer_state = state;
+    layer_cache_clear();
     hook_default_layer_change(default_layer_state);
     default_layer_debug(); debug("\n");
 #ifdef NO_TRACK_KEY_PRESS
@@ -66,6 +75,7 @@ static void layer_state_set(uint32_t state)
     dprint("layer_state: ");
     layer_debug(); dprint(" to ");
     layer_state = state;
+    layer_cache_clear();
     hook_layer_change(layer_state);
     layer_debug(); dprintln();
 #ifdef NO_TRACK_KEY_PRESS
@@ -119,21 +129,79 @@ void layer_debug(void)
 
 
 
+#if defined(TRANSPARENCY_MAP_ENABLE) && !defined(NO_ACTION_LAYER)
+/*
+ * Transparency map
+ *
+ * Bitmap of layers where key has non-transparent action, so that effective
+ * layer is highest bit of active layers masked with it. Map is made from
+ * action_for_key() at keyboard init, this reads keymap at runtime and keeps up
+ * with keymap patched by keymap editor in .keymap section. Call
+ * transparency_map_init() again when keymap is changed at runtime. Layers
+ * above TRANSPARENCY_MAP_LAYERS are looked up as usual.
+ */
+#ifndef TRANSPARENCY_MAP_LAYERS
+#define TRANSPARENCY_MAP_LAYERS 8
+#endif
+
+#if TRANSPARENCY_MAP_LAYERS <= 8
+typedef uint8_t  transparency_map_t;
+#elif TRANSPARENCY_MAP_LAYERS <= 16
+typedef uint16_t transparency_map_t;
+#elif TRANSPARENCY_MAP_LAYERS <= 32
+typedef uint32_t transparency_map_t;
+#else
+#error "TRANSPARENCY_MAP_LAYERS: 32 at most"
+#endif
+
+#define TRANSPARENCY_MAP_MASK   (0xFFFFFFFFUL >> (32 - TRANSPARENCY_MAP_LAYERS))
+
+static transparency_map_t nontransparent[MATRIX_ROWS][MATRIX_COLS];
+
+void transparency_map_init(void)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            transparency_map_t map = 0;
+            for (uint8_t i = 0; i < TRANSPARENCY_MAP_LAYERS; i++) {
+                action_t action = action_for_key(i, (keypos_t){ .row = r, .col = c });
+                if (action.code != (action_t)ACTION_TRANSPARENT.code) {
+                    map |= ((transparency_map_t)1<<i);
+                }
+            }
+            nontransparent[r][c] = map;
+        }
+    }
+    // cached layers were resolved with old keymap
+    layer_cache_clear();
+}
+#endif
+
 /* return layer effective for key at this time */
-static uint8_t current_layer_for_key(keypos_t key)
+static uint8_t current_layer_for_key_uncached(keypos_t key)
 {
 #ifndef NO_ACTION_LAYER
     action_t action = ACTION_TRANSPARENT;
     uint32_t layers = layer_state | default_layer_state;
-    /* check top layer first */
-    for (int8_t i = 31; i >= 0; i--) {
-        if (layers & (1UL<<i)) {
-            action = action_for_key(i, key);
-            if (action.code != (action_t)ACTION_TRANSPARENT.code) {
-                return i;
-            }
+#ifdef TRANSPARENCY_MAP_ENABLE
+    uint32_t mapped = layers & TRANSPARENCY_MAP_MASK;
+    layers &= ~TRANSPARENCY_MAP_MASK;
+#endif
+    /* check top layer first, visit only active layers */
+    while (layers) {
+        uint8_t i = biton32(layers);
+        action = action_for_key(i, key);
+        if (action.code != (action_t)ACTION_TRANSPARENT.code) {
+            return i;
         }
+        layers &= ~(1UL<<i);
     }
+#ifdef TRANSPARENCY_MAP_ENABLE
+    mapped &= nontransparent[key.row][key.col];
+    if (mapped) {
+        return biton32(mapped);
+    }
+#endif
     /* fall back to layer 0 */
     return 0;
 #else
@@ -142,6 +210,38 @@ static uint8_t current_layer_for_key(keypos_t key)
 }
 
 
+#if defined(LAYER_CACHE_ENABLE) && !defined(NO_ACTION_LAYER)
+/*
+ * Effective layer cache
+ *
+ * Layer resolved for a key is kept until layer_state or default_layer_state
+ * changes, the cache is refilled lazily key by key on press after that.
+ * action_for_key() must depend only on layer and key position to use this.
+ */
+static uint8_t layer_cache[MATRIX_ROWS][MATRIX_COLS];
+static matrix_row_t layer_cache_valid[MATRIX_ROWS];
+
+static void layer_cache_clear(void)
+{
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        layer_cache_valid[i] = 0;
+    }
+}
+
+static uint8_t current_layer_for_key(keypos_t key)
+{
+    matrix_row_t col_bit = ((matrix_row_t)1<<key.col);
+    if (!(layer_cache_valid[key.row] & col_bit)) {
+        layer_cache[key.row][key.col] = current_layer_for_key_uncached(key);
+        layer_cache_valid[key.row] |= col_bit;
+    }
+    return layer_cache[key.row][key.col];
+}
+#else
+#define current_layer_for_key(key)  current_layer_for_key_uncached(key)
+#endif
+
+
 #ifndef NO_TRACK_KEY_PRESS
 /* record layer on where key is pressed */
 static uint8_t layer_pressed[MATRIX_ROWS][MATRIX_COLS] = {};
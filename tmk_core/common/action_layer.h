@@ -55,6 +55,14 @@ void layer_xor(uint32_t state);
 #endif
 
 
+#if defined(TRANSPARENCY_MAP_ENABLE) && !defined(NO_ACTION_LAYER)
+/* build map of transparent keys, call again when keymap is changed */
+void transparency_map_init(void);
+#else
+#define transparency_map_init()
+#endif
+
+
 /* return action depending on current layer status */
 action_t layer_switch_get_action(keyevent_t key);
 
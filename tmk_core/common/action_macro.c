@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "action.h"
 #include "action_util.h"
 #include "action_macro.h"
+#include "timer.h"
 #include "wait.h"
 
 #ifdef DEBUG_ACTION
@@ -28,16 +29,31 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifndef NO_ACTION_MACRO
 
-#define MACRO_READ()  (macro = MACRO_GET(macro_p++))
-void action_macro_play(const macro_t *macro_p)
+/* Macro player
+ *
+ * Keeps cursor into macro_t stream so that playing can be stopped at WAIT
+ * and INTERVAL and resumed later.
+ */
+typedef struct {
+    const macro_t *p;       /* next command, MACRO_NONE when stopped */
+    uint16_t wait_start;    /* timer_read() when waiting started */
+    uint16_t wait;          /* ms to wait before next command */
+    uint8_t interval;
+    uint8_t mod_storage;
+} macro_player_t;
+
+#define MACRO_READ()  (macro = MACRO_GET(player->p++))
+/* execute commands until macro ends or needs to wait, returns false at end. */
+static bool macro_player_step(macro_player_t *player)
 {
     macro_t macro = END;
-    uint8_t interval = 0;
 
-    uint8_t mod_storage = 0;
+    while (player->p) {
+        if (player->wait) {
+            if (timer_elapsed(player->wait_start) < player->wait) return true;
+            player->wait = 0;
+        }
 
-    if (!macro_p) return;
-    while (true) {
         switch (MACRO_READ()) {
             case KEY_DOWN:
                 MACRO_READ();
@@ -62,17 +78,17 @@ void action_macro_play(const macro_t *macro_p)
             case WAIT:
                 MACRO_READ();
                 dprintf("WAIT(%u)\n", macro);
-                { uint8_t ms = macro; while (ms--) wait_ms(1); }
+                player->wait = macro;
                 break;
             case INTERVAL:
-                interval = MACRO_READ();
-                dprintf("INTERVAL(%u)\n", interval);
+                player->interval = MACRO_READ();
+                dprintf("INTERVAL(%u)\n", player->interval);
                 break;
             case MOD_STORE:
-                mod_storage = get_mods();
+                player->mod_storage = get_mods();
                 break;
             case MOD_RESTORE:
-                set_mods(mod_storage);
+                set_mods(player->mod_storage);
                 send_keyboard_report();
                 break;
             case MOD_CLEAR:
@@ -89,10 +105,64 @@ void action_macro_play(const macro_t *macro_p)
                 break;
             case END:
             default:
-                return;
+                player->p = MACRO_NONE;
+                return false;
         }
         // interval
-        { uint8_t ms = interval; while (ms--) wait_ms(1); }
+        player->wait += player->interval;
+        player->wait_start = timer_read();
+    }
+    return false;
+}
+
+
+#ifndef ACTION_MACRO_ASYNC
+void action_macro_play(const macro_t *macro_p)
+{
+    macro_player_t player = { .p = macro_p };
+
+    while (macro_player_step(&player)) {
+        flush_keyboard_report();
+        wait_ms(1);
+    }
+}
+#else
+static macro_player_t macro_queue[ACTION_MACRO_QUEUE_SIZE];
+static uint8_t macro_queue_tail = 0;     /* macro playing now */
+static uint8_t macro_queue_count = 0;
+
+void action_macro_play(const macro_t *macro_p)
+{
+    if (!macro_p) return;
+
+    if (macro_queue_count == ACTION_MACRO_QUEUE_SIZE) {
+        dprint("action_macro_play: queue full, wait.\n");
+        while (macro_queue_count == ACTION_MACRO_QUEUE_SIZE) {
+            flush_keyboard_report();
+            wait_ms(1);
+            action_macro_task();
+        }
     }
+    macro_queue[(macro_queue_tail + macro_queue_count) % ACTION_MACRO_QUEUE_SIZE] = (macro_player_t){ .p = macro_p };
+    macro_queue_count++;
+
+    // play until first wait, macro without WAIT and INTERVAL completes here
+    action_macro_task();
 }
+
+void action_macro_task(void)
+{
+    while (macro_queue_count) {
+        if (macro_player_step(&macro_queue[macro_queue_tail])) return;
+        macro_queue_tail = (macro_queue_tail + 1) % ACTION_MACRO_QUEUE_SIZE;
+        macro_queue_count--;
+    }
+}
+
+bool action_macro_is_playing(void)
+{
+    return macro_queue_count;
+}
+#endif
+
 #endif
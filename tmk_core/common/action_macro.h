@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ACTION_MACRO_H
 #define ACTION_MACRO_H
 #include <stdint.h>
+#include <stdbool.h>
 #include "progmem.h"
 
 
@@ -33,6 +34,19 @@ void action_macro_play(const macro_t *macro_p);
 #define action_macro_play(macro)
 #endif
 
+/* Non-blocking macro
+ * With ACTION_MACRO_ASYNC action_macro_play() queues macro and returns at once,
+ * action_macro_task() called from keyboard_task() plays queued macros in order
+ * and leaves at WAIT and INTERVAL instead of spinning in wait_ms().
+ */
+#if !defined(NO_ACTION_MACRO) && defined(ACTION_MACRO_ASYNC)
+#ifndef ACTION_MACRO_QUEUE_SIZE
+#define ACTION_MACRO_QUEUE_SIZE 4
+#endif
+void action_macro_task(void);
+bool action_macro_is_playing(void);
+#endif
+
 
 
 /* Macro commands
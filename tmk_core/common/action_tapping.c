@@ -18,10 +18,19 @@
 #define IS_TAPPING_PRESSED()    (IS_TAPPING() && tapping_key.event.pressed)
 #define IS_TAPPING_RELEASED()   (IS_TAPPING() && !tapping_key.event.pressed)
 #define IS_TAPPING_KEY(k)       (IS_TAPPING() && KEYEQ(tapping_key.event.key, (k)))
-#define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < TAPPING_TERM)
+#ifdef TAPPING_TERM_PER_KEY
+#define GET_TAPPING_TERM()      action_tapping_term(tapping_key.event)
+#define GET_TAPPING_POLICY()    action_tapping_policy(tapping_key.event)
+#else
+#define GET_TAPPING_TERM()      TAPPING_TERM
+#define GET_TAPPING_POLICY()    TAPPING_POLICY
+#endif
+#define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < GET_TAPPING_TERM())
 
 
 static keyrecord_t tapping_key = {};
+/* tap key held over tapping term without interruption, for RETRO_TAP */
+static keyrecord_t retro_tap_key = {};
 static keyrecord_t waiting_buffer[WAITING_BUFFER_SIZE] = {};
 static uint8_t waiting_buffer_head = 0;
 static uint8_t waiting_buffer_tail = 0;
@@ -29,12 +38,29 @@ static uint8_t waiting_buffer_tail = 0;
 static bool process_tapping(keyrecord_t *record);
 static bool waiting_buffer_enq(keyrecord_t record);
 static void waiting_buffer_clear(void);
+static void waiting_buffer_process(void);
+static void waiting_buffer_settle(void);
 static bool waiting_buffer_typed(keyevent_t event);
 static void waiting_buffer_scan_tap(void);
 static void debug_tapping_key(void);
 static void debug_waiting_buffer(void);
 
 
+#ifdef TAPPING_TERM_PER_KEY
+__attribute__ ((weak))
+uint16_t action_tapping_term(keyevent_t event)
+{
+    return TAPPING_TERM;
+}
+
+__attribute__ ((weak))
+uint8_t action_tapping_policy(keyevent_t event)
+{
+    return TAPPING_POLICY;
+}
+#endif
+
+
 void action_tapping_process(keyrecord_t record)
 {
     if (process_tapping(&record)) {
@@ -43,11 +69,16 @@ void action_tapping_process(keyrecord_t record)
         }
     } else {
         if (!waiting_buffer_enq(record)) {
-            // clear all in case of overflow.
-            debug("OVERFLOW: CLEAR ALL STATES\n");
-            clear_keyboard();
-            waiting_buffer_clear();
-            tapping_key = (keyrecord_t){};
+            // settle tapping as hold to make room for the event
+            debug("OVERFLOW: SETTLE TAPPING\n");
+            waiting_buffer_settle();
+            if (!waiting_buffer_enq(record)) {
+                // clear all in case of overflow.
+                debug("OVERFLOW: CLEAR ALL STATES\n");
+                clear_keyboard();
+                waiting_buffer_clear();
+                tapping_key = (keyrecord_t){};
+            }
         }
     }
 
@@ -55,14 +86,7 @@ void action_tapping_process(keyrecord_t record)
     if (!IS_NOEVENT(record.event) && waiting_buffer_head != waiting_buffer_tail) {
         debug("---- action_exec: process waiting_buffer -----\n");
     }
-    for (; waiting_buffer_tail != waiting_buffer_head; waiting_buffer_tail = (waiting_buffer_tail + 1) % WAITING_BUFFER_SIZE) {
-        if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
-            debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
-            debug_record(waiting_buffer[waiting_buffer_tail]); debug("\n\n");
-        } else {
-            break;
-        }
-    }
+    waiting_buffer_process();
     if (!IS_NOEVENT(record.event)) {
         debug("\n");
     }
@@ -95,12 +119,12 @@ bool process_tapping(keyrecord_t *keyp)
                     // enqueue
                     return false;
                 }
-#if TAPPING_TERM >= 500
                 /* Process a key typed within TAPPING_TERM
                  * This can register the key before settlement of tapping,
                  * useful for long TAPPING_TERM but may prevent fast typing.
                  */
-                else if (IS_RELEASED(event) && waiting_buffer_typed(event)) {
+                else if ((GET_TAPPING_TERM() >= 500 || (GET_TAPPING_POLICY() & TAPPING_PERMISSIVE_HOLD)) &&
+                        IS_RELEASED(event) && waiting_buffer_typed(event)) {
                     debug("Tapping: End. No tap. Interfered by typing key\n");
                     process_action(&tapping_key);
                     tapping_key = (keyrecord_t){};
@@ -108,7 +132,6 @@ bool process_tapping(keyrecord_t *keyp)
                     // enqueue
                     return false;
                 }
-#endif
                 /* Process release event of a key pressed before tapping starts
                  * Without this unexpected repeating will occur with having fast repeating setting
                  * https://github.com/tmk/tmk_keyboard/issues/60
@@ -137,6 +160,12 @@ bool process_tapping(keyrecord_t *keyp)
                     // set interrupted flag when other key preesed during tapping
                     if (event.pressed) {
                         tapping_key.tap.interrupted = true;
+                        if (GET_TAPPING_POLICY() & TAPPING_HOLD_ON_OTHER_KEY_PRESS) {
+                            debug("Tapping: End. No tap. Interrupted by key press\n");
+                            process_action(&tapping_key);
+                            tapping_key = (keyrecord_t){};
+                            debug_tapping_key();
+                        }
                     }
                     // enqueue 
                     return false;
@@ -184,6 +213,9 @@ bool process_tapping(keyrecord_t *keyp)
             if (tapping_key.tap.count == 0) {
                 debug("Tapping: End. Timeout. Not tap(0): ");
                 debug_event(event); debug("\n");
+                if ((GET_TAPPING_POLICY() & TAPPING_RETRO_TAP) && !tapping_key.tap.interrupted) {
+                    retro_tap_key = tapping_key;
+                }
                 process_action(&tapping_key);
                 tapping_key = (keyrecord_t){};
                 debug_tapping_key();
@@ -272,12 +304,25 @@ bool process_tapping(keyrecord_t *keyp)
     }
     // not tapping state
     else {
+        if (event.pressed) {
+            retro_tap_key = (keyrecord_t){};
+        }
         if (event.pressed && is_tap_key(event)) {
             debug("Tapping: Start(Press tap key).\n");
             tapping_key = *keyp;
             waiting_buffer_scan_tap();
             debug_tapping_key();
             return true;
+        } else if (!IS_NOEVENT(retro_tap_key.event) && KEYEQ(event.key, retro_tap_key.event.key)) {
+            debug("Tapping: Retro tap.\n");
+            process_action(keyp);
+            retro_tap_key.tap.count = 1;
+            retro_tap_key.event.time = event.time;
+            process_action(&retro_tap_key);
+            retro_tap_key.event.pressed = false;
+            process_action(&retro_tap_key);
+            retro_tap_key = (keyrecord_t){};
+            return true;
         } else {
             process_action(keyp);
             return true;
@@ -295,13 +340,13 @@ bool waiting_buffer_enq(keyrecord_t record)
         return true;
     }
 
-    if ((waiting_buffer_head + 1) % WAITING_BUFFER_SIZE == waiting_buffer_tail) {
+    if (((waiting_buffer_head + 1) & WAITING_BUFFER_MASK) == waiting_buffer_tail) {
         debug("waiting_buffer_enq: Over flow.\n");
         return false;
     }
 
     waiting_buffer[waiting_buffer_head] = record;
-    waiting_buffer_head = (waiting_buffer_head + 1) % WAITING_BUFFER_SIZE;
+    waiting_buffer_head = (waiting_buffer_head + 1) & WAITING_BUFFER_MASK;
 
     debug("waiting_buffer_enq: "); debug_waiting_buffer();
     return true;
@@ -313,9 +358,36 @@ void waiting_buffer_clear(void)
     waiting_buffer_tail = 0;
 }
 
+void waiting_buffer_process(void)
+{
+    for (; waiting_buffer_tail != waiting_buffer_head; waiting_buffer_tail = (waiting_buffer_tail + 1) & WAITING_BUFFER_MASK) {
+        if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
+            debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
+            debug_record(waiting_buffer[waiting_buffer_tail]); debug("\n\n");
+        } else {
+            break;
+        }
+    }
+}
+
+/* Resolve pending tapping key as hold like timeout and process events held for it.
+ * Events in buffer are processed in order, first of them is consumed at least
+ * since tapping is not active then.
+ */
+void waiting_buffer_settle(void)
+{
+    if (IS_TAPPING_PRESSED() && tapping_key.tap.count == 0) {
+        debug("Tapping: End. Buffer full. Not tap(0)\n");
+        process_action(&tapping_key);
+        tapping_key = (keyrecord_t){};
+        debug_tapping_key();
+    }
+    waiting_buffer_process();
+}
+
 bool waiting_buffer_typed(keyevent_t event)
 {
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
+    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) & WAITING_BUFFER_MASK) {
         if (KEYEQ(event.key, waiting_buffer[i].event.key) && event.pressed !=  waiting_buffer[i].event.pressed) {
             return true;
         }
@@ -331,7 +403,7 @@ void waiting_buffer_scan_tap(void)
     // invalid state: tapping_key released && tap.count == 0
     if (!tapping_key.event.pressed) return;
 
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
+    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) & WAITING_BUFFER_MASK) {
         if (IS_TAPPING_KEY(waiting_buffer[i].event.key) &&
                 !waiting_buffer[i].event.pressed &&
                 WITHIN_TAPPING_TERM(waiting_buffer[i].event)) {
@@ -358,7 +430,7 @@ static void debug_tapping_key(void)
 static void debug_waiting_buffer(void)
 {
     debug("{ ");
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
+    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) & WAITING_BUFFER_MASK) {
         debug("["); debug_dec(i); debug("]="); debug_record(waiting_buffer[i]); debug(" ");
     }
     debug("}\n");
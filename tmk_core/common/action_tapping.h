@@ -29,11 +29,40 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define TAPPING_TOGGLE  5
 #endif
 
+/* Tapping policy flags
+ *   PERMISSIVE_HOLD:           hold when other key is typed(pressed and released) during tapping
+ *   HOLD_ON_OTHER_KEY_PRESS:   hold as soon as other key is pressed during tapping
+ *   RETRO_TAP:                 tap on release after TAPPING_TERM unless other key is pressed
+ */
+#define TAPPING_PERMISSIVE_HOLD         (1<<0)
+#define TAPPING_HOLD_ON_OTHER_KEY_PRESS (1<<1)
+#define TAPPING_RETRO_TAP               (1<<2)
+
+/* policy of tap keys */
+#ifndef TAPPING_POLICY
+#define TAPPING_POLICY  0
+#endif
+
+/* number of key events held while tapping is settled, must be 2^n and up to 128 */
+#ifndef WAITING_BUFFER_SIZE
 #define WAITING_BUFFER_SIZE 8
+#endif
+#define WAITING_BUFFER_MASK (WAITING_BUFFER_SIZE - 1)
+
+#if (WAITING_BUFFER_SIZE & WAITING_BUFFER_MASK) || WAITING_BUFFER_SIZE > 128
+#error "WAITING_BUFFER_SIZE: must be 2^n and up to 128"
+#endif
 
 
 #ifndef NO_ACTION_TAPPING
 void action_tapping_process(keyrecord_t record);
+
+#ifdef TAPPING_TERM_PER_KEY
+/* tapping term(ms) and policy of tap key press event, TAPPING_TERM and TAPPING_POLICY by default.
+ * These are called on every event during tapping and should be quick. */
+uint16_t action_tapping_term(keyevent_t event);
+uint8_t action_tapping_policy(keyevent_t event);
+#endif
 #endif
 
 #endif
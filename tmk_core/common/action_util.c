@@ -14,6 +14,7 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
 #include "host.h"
 #include "report.h"
 #include "debug.h"
@@ -44,6 +45,12 @@ static int8_t cb_count = 0;
 //report_keyboard_t keyboard_report = {};
 report_keyboard_t *keyboard_report = &(report_keyboard_t){};
 
+#ifdef REPORT_COALESCE
+static report_keyboard_t report_sent = {};
+static report_keyboard_t report_pending = {};
+static bool report_dirty = false;
+#endif
+
 #ifndef NO_ACTION_ONESHOT
 static int8_t oneshot_mods = 0;
 #if (defined(ONESHOT_TIMEOUT) && (ONESHOT_TIMEOUT > 0))
@@ -69,7 +76,92 @@ void send_keyboard_report(void) {
         }
     }
 #endif
+#ifdef REPORT_COALESCE
+    if (report_dirty && keyboard_report_needs_flush(&report_sent, &report_pending, keyboard_report)) {
+        flush_keyboard_report();
+    }
+    report_pending = *keyboard_report;
+    report_dirty = true;
+#else
     host_keyboard_send(keyboard_report);
+#endif
+}
+
+#ifdef REPORT_COALESCE
+void flush_keyboard_report(void)
+{
+    if (!report_dirty) return;
+    report_dirty = false;
+    if (memcmp(&report_pending, &report_sent, sizeof(report_keyboard_t)) == 0) return;
+    host_keyboard_send(&report_pending);
+    report_sent = report_pending;
+}
+#endif
+
+static bool report_has_key(const report_keyboard_t *report, uint8_t code)
+{
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (report->keys[i] == code) return true;
+    }
+    return false;
+}
+
+/* true when merging next into pending report loses event or order of changes */
+bool keyboard_report_needs_flush(const report_keyboard_t *sent, const report_keyboard_t *pending,
+                                 const report_keyboard_t *next)
+{
+    bool pending_keys = false;  /* keys changed from sent to pending */
+    bool next_keys = false;     /* keys changed from pending to next */
+    bool pending_press = false; /* keys pressed from sent to pending */
+    bool next_press = false;    /* keys pressed from pending to next */
+
+#ifdef NKRO_ENABLE
+    if (keyboard_protocol && keyboard_nkro) {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_BITS; i++) {
+            uint8_t p = pending->nkro.bits[i] ^ sent->nkro.bits[i];
+            uint8_t n = next->nkro.bits[i] ^ pending->nkro.bits[i];
+            // key changes twice
+            if (p & n) return true;
+            if (p) pending_keys = true;
+            if (n) next_keys = true;
+            if (p & pending->nkro.bits[i]) pending_press = true;
+            if (n & next->nkro.bits[i]) next_press = true;
+        }
+    } else
+#endif
+    {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            uint8_t code;
+            // pressed and released
+            if ((code = pending->keys[i]) && !report_has_key(sent, code)) {
+                pending_keys = true;
+                pending_press = true;
+                if (!report_has_key(next, code)) return true;
+            }
+            // released and pressed again
+            if ((code = sent->keys[i]) && !report_has_key(pending, code)) {
+                pending_keys = true;
+                if (report_has_key(next, code)) return true;
+            }
+            if ((code = next->keys[i]) && !report_has_key(pending, code)) {
+                next_keys = true;
+                next_press = true;
+            }
+            if ((code = pending->keys[i]) && !report_has_key(next, code)) next_keys = true;
+        }
+    }
+
+    // keep order of key presses
+    if (pending_press && next_press) return true;
+
+    uint8_t pending_mods = pending->mods ^ sent->mods;
+    uint8_t next_mods = next->mods ^ pending->mods;
+    // modifier changes twice
+    if (pending_mods & next_mods) return true;
+    // keep order of modifier and key changes
+    if (pending_mods && next_keys) return true;
+    if (pending_keys && next_mods) return true;
+    return false;
 }
 
 /* key */
@@ -135,6 +227,14 @@ void clear_oneshot_mods(void)
 #endif
 }
 #endif
+uint8_t get_oneshot_mods(void)
+{
+#ifndef NO_ACTION_ONESHOT
+    return oneshot_mods;
+#else
+    return 0;
+#endif
+}
 
 
 
@@ -28,6 +28,24 @@ extern report_keyboard_t *keyboard_report;
 
 void send_keyboard_report(void);
 
+/* Report coalescing
+ * With REPORT_COALESCE send_keyboard_report() only updates pending report and
+ * flush_keyboard_report() sends it, keyboard_task() flushes once per loop.
+ * Pending report is sent earlier when a change would be lost by merging, like
+ * key pressed and released, or to keep order of key presses and modifier changes.
+ */
+#ifdef REPORT_COALESCE
+void flush_keyboard_report(void);
+#else
+#define flush_keyboard_report()
+#endif
+
+/* true when replacing pending report with next loses key press or release, or
+ * order of changes. sent is the last report given to host. Also used by
+ * protocol drivers to merge reports queued for endpoint. */
+bool keyboard_report_needs_flush(const report_keyboard_t *sent, const report_keyboard_t *pending,
+                                 const report_keyboard_t *next);
+
 /* key */
 void add_key(uint8_t key);
 void del_key(uint8_t key);
@@ -50,6 +68,7 @@ void clear_weak_mods(void);
 /* oneshot modifier */
 void set_oneshot_mods(uint8_t mods);
 void clear_oneshot_mods(void);
+uint8_t get_oneshot_mods(void);
 void oneshot_toggle(void);
 void oneshot_enable(void);
 void oneshot_disable(void);
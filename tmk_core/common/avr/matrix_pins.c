@@ -0,0 +1,176 @@
+/*
+ * Generic matrix driver configured with pin tables in config.h
+ *
+ * Rows are driven low one by one and columns are read with pull-up, key is on
+ * when column is low(diode from column to row, same as most of TMK boards).
+ *
+ *     #define MATRIX_ROW_PINS { MATRIX_PIN(D, 0), MATRIX_PIN(D, 1), MATRIX_PIN(C, 2) }
+ *     #define MATRIX_COL_PINS { MATRIX_PIN(B, 0), MATRIX_PIN(B, 1), MATRIX_PIN(F, 7) }
+ *
+ * Pin tables are kept in flash. Column pins are grouped by port at init so
+ * that a row is read with one PIN read per port instead of a bit test per
+ * column. Columns wired to consecutive pins in order are gathered with a
+ * shift, on other ports columns are looked up in the pin table only when a
+ * key is on, so idle rows cost a few instructions per port.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include "matrix.h"
+#include "debounce.h"
+
+
+#if !defined(MATRIX_ROW_PINS) || !defined(MATRIX_COL_PINS)
+#   error "MATRIX_ROW_PINS and MATRIX_COL_PINS are required in config.h"
+#endif
+
+/* delay for settling after selecting row */
+#ifndef MATRIX_IO_DELAY
+#   define MATRIX_IO_DELAY  1
+#endif
+
+/* pin: address of PINx register and bit number
+ * DDRx and PORTx follow PINx at next addresses on megaAVR. */
+#define MATRIX_PIN(port, bit)   (((uint16_t)_SFR_MEM_ADDR(PIN##port) << 3) | (bit))
+#define PIN_REG(pin)            ((volatile uint8_t *)((pin) >> 3))
+#define PIN_BIT(pin)            ((uint8_t)1 << ((pin) & 7))
+#define DDR_REG(reg)            ((reg) + 1)
+#define PORT_REG(reg)           ((reg) + 2)
+
+/* ports used for columns: I/O ports of the device or number of columns
+ * whichever is less, so that columns on any pins fit in the table */
+#if   defined(PINL)
+#   define COL_PORTS 11
+#elif defined(PINK)
+#   define COL_PORTS 10
+#elif defined(PINJ)
+#   define COL_PORTS 9
+#elif defined(PINH)
+#   define COL_PORTS 8
+#elif defined(PING)
+#   define COL_PORTS 7
+#elif defined(PINF)
+#   define COL_PORTS 6
+#elif defined(PINE)
+#   define COL_PORTS 5
+#elif defined(PIND)
+#   define COL_PORTS 4
+#else
+#   error "matrix_pins.c: unknown I/O ports of MCU"
+#endif
+#if MATRIX_COLS < COL_PORTS
+#   undef  COL_PORTS
+#   define COL_PORTS MATRIX_COLS
+#endif
+
+typedef struct {
+    volatile uint8_t *reg;
+    uint8_t mask;           /* pins used for columns */
+    int8_t shift;           /* pins map to columns with this shift, or -1 */
+} col_port_t;
+
+static const uint16_t row_pins[MATRIX_ROWS] PROGMEM = MATRIX_ROW_PINS;
+static const uint16_t col_pins[MATRIX_COLS] PROGMEM = MATRIX_COL_PINS;
+
+static col_port_t ports[COL_PORTS];
+static uint8_t nports = 0;
+
+/* matrix state(1:on, 0:off) */
+static matrix_row_t matrix[MATRIX_ROWS];
+
+
+static void init_pins(void)
+{
+    // Rows: Hi-Z(DDR:0, PORT:0) to unselect
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        uint16_t pin = pgm_read_word(&row_pins[r]);
+        *DDR_REG(PIN_REG(pin))  &= ~PIN_BIT(pin);
+        *PORT_REG(PIN_REG(pin)) &= ~PIN_BIT(pin);
+    }
+
+    // Columns: input with pull-up(DDR:0, PORT:1), grouped by port
+    nports = 0;
+    for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+        uint16_t pin = pgm_read_word(&col_pins[c]);
+        volatile uint8_t *reg = PIN_REG(pin);
+        uint8_t bit = pin & 7;
+
+        uint8_t p;
+        for (p = 0; p < nports && ports[p].reg != reg; p++) ;
+        if (p == nports) {
+            ports[p] = (col_port_t){ .reg = reg, .shift = (c >= bit ? c - bit : -1) };
+            nports++;
+        }
+        ports[p].mask |= (1<<bit);
+        if (c - bit != ports[p].shift) ports[p].shift = -1;
+
+        *DDR_REG(reg)  &= ~(1<<bit);
+        *PORT_REG(reg) |=  (1<<bit);
+    }
+}
+
+/* Returns status of switches(1:on, 0:off) */
+static matrix_row_t read_cols(void)
+{
+    matrix_row_t cols = 0;
+    for (uint8_t p = 0; p < nports; p++) {
+        // Invert because PIN indicates 'switch on' with low(0)
+        uint8_t on = ~*ports[p].reg & ports[p].mask;
+        if (!on) continue;
+        if (ports[p].shift >= 0) {
+            cols |= (matrix_row_t)on << ports[p].shift;
+        } else {
+            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+                uint16_t pin = pgm_read_word(&col_pins[c]);
+                if (PIN_REG(pin) == ports[p].reg && (on & PIN_BIT(pin))) {
+                    cols |= ((matrix_row_t)1<<c);
+                }
+            }
+        }
+    }
+    return cols;
+}
+
+static void select_row(uint8_t row)
+{
+    // Output low(DDR:1, PORT:0) to select
+    uint16_t pin = pgm_read_word(&row_pins[row]);
+    *DDR_REG(PIN_REG(pin))  |=  PIN_BIT(pin);
+    *PORT_REG(PIN_REG(pin)) &= ~PIN_BIT(pin);
+}
+
+static void unselect_row(uint8_t row)
+{
+    // Hi-Z(DDR:0, PORT:0) to unselect
+    uint16_t pin = pgm_read_word(&row_pins[row]);
+    *DDR_REG(PIN_REG(pin))  &= ~PIN_BIT(pin);
+}
+
+void matrix_init(void)
+{
+    init_pins();
+
+    // initialize matrix state: all keys off
+    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
+        matrix[i] = 0;
+    }
+    debounce_init(matrix);
+}
+
+uint8_t matrix_scan(void)
+{
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        select_row(i);
+        _delay_us(MATRIX_IO_DELAY);  // delay for settling
+        debounce_row(i, read_cols());
+        unselect_row(i);
+    }
+    return debounce_update();
+}
+
+matrix_row_t matrix_get_row(uint8_t row)
+{
+    return matrix[row];
+}
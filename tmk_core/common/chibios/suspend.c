@@ -31,9 +31,12 @@ __attribute__ ((weak)) void matrix_power_up(void) {}
 __attribute__ ((weak)) void matrix_power_down(void) {}
 bool suspend_wakeup_condition(void)
 {
+#ifndef MATRIX_SCAN_THREAD
+    /* matrix is kept updated by scan thread */
     matrix_power_up();
     matrix_scan();
     matrix_power_down();
+#endif
     for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
         if (matrix_get_row(r)) return true;
     }
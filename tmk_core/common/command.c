@@ -235,6 +235,7 @@ static bool command_common(uint8_t code)
             break;
         case KC_PAUSE:
             clear_keyboard();
+            flush_keyboard_report();
             print("\n\nbootloader... ");
             wait_ms(1000);
             bootloader_jump(); // not return
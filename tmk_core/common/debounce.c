@@ -0,0 +1,262 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "debug.h"
+#include "debounce.h"
+
+
+static matrix_row_t *matrix;
+static bool changed = false;
+
+
+#if (DEBOUNCE_ALGO == DEBOUNCE_GLOBAL_DEFER)
+static matrix_row_t matrix_debouncing[MATRIX_ROWS];
+static bool debouncing = false;
+static uint16_t debouncing_time = 0;
+
+void debounce_init(matrix_row_t *m)
+{
+    matrix = m;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        matrix_debouncing[i] = 0;
+    }
+    debouncing = false;
+    changed = false;
+}
+
+void debounce_row(uint8_t row, matrix_row_t raw)
+{
+    if (matrix_debouncing[row] != raw) {
+        if (debouncing) {
+            dprintf("bounce: %d %d@%02X\n", timer_elapsed(debouncing_time), row, matrix_debouncing[row]^raw);
+        }
+        matrix_debouncing[row] = raw;
+        debouncing = true;
+        debouncing_time = timer_read();
+    }
+}
+
+uint8_t debounce_update(void)
+{
+    if (debouncing && timer_elapsed(debouncing_time) >= DEBOUNCE) {
+        for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+            if (matrix[i] != matrix_debouncing[i]) {
+                matrix[i] = matrix_debouncing[i];
+                changed = true;
+            }
+        }
+        debouncing = false;
+    }
+
+    uint8_t ret = changed;
+    changed = false;
+    return ret;
+}
+
+
+#elif (DEBOUNCE_ALGO == DEBOUNCE_ROW_DEFER)
+#if (DEBOUNCE > 255)
+#   error "DEBOUNCE must not exceed 255 with DEBOUNCE_ROW_DEFER"
+#endif
+static matrix_row_t matrix_debouncing[MATRIX_ROWS];
+/* bit per row: row is waiting for settlement */
+static uint8_t debouncing[(MATRIX_ROWS + 7) / 8];
+/* lower byte of timer at last bounce of row */
+static uint8_t debouncing_time[MATRIX_ROWS];
+
+void debounce_init(matrix_row_t *m)
+{
+    matrix = m;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        matrix_debouncing[i] = 0;
+    }
+    for (uint8_t i = 0; i < sizeof(debouncing); i++) {
+        debouncing[i] = 0;
+    }
+    changed = false;
+}
+
+void debounce_row(uint8_t row, matrix_row_t raw)
+{
+    if (matrix_debouncing[row] != raw) {
+        matrix_debouncing[row] = raw;
+        debouncing[row>>3] |= (1<<(row&7));
+        debouncing_time[row] = (uint8_t)timer_read();
+    }
+}
+
+uint8_t debounce_update(void)
+{
+    uint8_t now = 0;
+    bool now_read = false;
+
+    for (uint8_t i = 0; i < sizeof(debouncing); i++) {
+        for (uint8_t bits = debouncing[i]; bits; bits &= bits - 1) {
+            if (!now_read) {
+                now = (uint8_t)timer_read();
+                now_read = true;
+            }
+            uint8_t row = (i<<3) | __builtin_ctz(bits);
+            if (TIMER_DIFF_8(now, debouncing_time[row]) >= DEBOUNCE) {
+                if (matrix[row] != matrix_debouncing[row]) {
+                    matrix[row] = matrix_debouncing[row];
+                    changed = true;
+                }
+                debouncing[i] &= ~(1<<(row&7));
+            }
+        }
+    }
+
+    uint8_t ret = changed;
+    changed = false;
+    return ret;
+}
+
+
+#elif (DEBOUNCE_ALGO == DEBOUNCE_KEY_EAGER)
+#if (DEBOUNCE > 255)
+#   error "DEBOUNCE must not exceed 255 with DEBOUNCE_KEY_EAGER"
+#endif
+/* bit per key: key is locked out after its last reported edge */
+static matrix_row_t locked[MATRIX_ROWS];
+/* remaining lockout time(ms) of key */
+static uint8_t lockout[MATRIX_ROWS][MATRIX_COLS];
+static uint8_t locked_rows = 0;
+static uint8_t last_time = 0;
+
+void debounce_init(matrix_row_t *m)
+{
+    matrix = m;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        locked[i] = 0;
+    }
+    locked_rows = 0;
+    changed = false;
+}
+
+void debounce_row(uint8_t row, matrix_row_t raw)
+{
+    matrix_row_t change = (matrix[row] ^ raw) & ~locked[row];
+    if (!change) return;
+
+    // report edge now and lock the key out
+    matrix[row] ^= change;
+    changed = true;
+    if (!locked_rows) {
+        last_time = (uint8_t)timer_read();
+    }
+    if (!locked[row]) locked_rows++;
+    locked[row] |= change;
+    for (; change; change &= change - 1) {
+        lockout[row][matrix_row_ctz(change)] = DEBOUNCE;
+    }
+}
+
+uint8_t debounce_update(void)
+{
+    if (locked_rows) {
+        uint8_t now = (uint8_t)timer_read();
+        uint8_t elapsed = TIMER_DIFF_8(now, last_time);
+        last_time = now;
+
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            if (!locked[row]) continue;
+            for (matrix_row_t bits = locked[row]; bits; bits &= bits - 1) {
+                uint8_t col = matrix_row_ctz(bits);
+                if (lockout[row][col] <= elapsed) {
+                    lockout[row][col] = 0;
+                    locked[row] &= ~((matrix_row_t)1<<col);
+                } else {
+                    lockout[row][col] -= elapsed;
+                }
+            }
+            if (!locked[row]) locked_rows--;
+        }
+    }
+
+    uint8_t ret = changed;
+    changed = false;
+    return ret;
+}
+
+
+#elif (DEBOUNCE_ALGO == DEBOUNCE_KEY_DEFER)
+#if (DEBOUNCE > 765)
+#   error "DEBOUNCE must not exceed 765 with DEBOUNCE_KEY_DEFER"
+#endif
+/* sampling period(ms): key changes when four samples in a row differ from
+ * debounced state, the samples span three periods. */
+#define SAMPLE_PERIOD   ((DEBOUNCE + 2) / 3)
+
+/* Vertical counter
+ * 2-bit counter of each key is sliced into two words per row, bit n of
+ * cnt0/cnt1 is the counter of column n. Counter is cleared while a key
+ * agrees with debounced state and is counted 0->1->2->3->0 on each sample
+ * while it disagrees, key is toggled when the counter wraps to 0.
+ */
+static matrix_row_t cnt0[MATRIX_ROWS];
+static matrix_row_t cnt1[MATRIX_ROWS];
+/* whether this scan is a sample and whether any counter is running */
+static bool sampling = true;
+static bool counting = false;
+/* first row of scan is not read yet */
+static bool scan_start = true;
+static uint8_t last_time = 0;
+
+void debounce_init(matrix_row_t *m)
+{
+    matrix = m;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        cnt0[i] = 0;
+        cnt1[i] = 0;
+    }
+    sampling = true;
+    counting = false;
+    scan_start = true;
+    changed = false;
+}
+
+void debounce_row(uint8_t row, matrix_row_t raw)
+{
+    if (scan_start) {
+        // decide whether this scan is a sample before any row is taken,
+        // samples are SAMPLE_PERIOD apart while counting.
+        scan_start = false;
+        uint8_t now = (uint8_t)timer_read();
+        if (!sampling && TIMER_DIFF_8(now, last_time) >= SAMPLE_PERIOD) {
+            sampling = true;
+        }
+        if (sampling) last_time = now;
+    }
+    if (!sampling) return;
+
+    matrix_row_t delta = raw ^ matrix[row];
+    cnt1[row] = (cnt1[row] ^ cnt0[row]) & delta;
+    cnt0[row] = ~cnt0[row] & delta;
+    matrix_row_t toggle = delta & ~(cnt0[row] | cnt1[row]);
+    if (toggle) {
+        matrix[row] ^= toggle;
+        changed = true;
+    }
+    if (delta & ~toggle) counting = true;
+}
+
+uint8_t debounce_update(void)
+{
+    // sample every scan while all keys are stable to catch first change
+    // without delay, then every SAMPLE_PERIOD while counting.
+    if (sampling && counting) {
+        sampling = false;
+    }
+    counting = false;
+    scan_start = true;
+
+    uint8_t ret = changed;
+    changed = false;
+    return ret;
+}
+
+
+#else
+#   error "DEBOUNCE_ALGO: invalid value"
+#endif
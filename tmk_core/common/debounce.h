@@ -0,0 +1,50 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include "matrix.h"
+
+
+/* debounce time(ms) */
+#ifndef DEBOUNCE
+#   define DEBOUNCE 5
+#endif
+
+/* Debounce algorithms: select with DEBOUNCE_ALGO in config.h
+ *
+ * DEBOUNCE_GLOBAL_DEFER: Report all keys DEBOUNCE ms after last bounce on
+ *      whole matrix. Classic and the smallest, but any bounce on the board
+ *      delays all keys.
+ * DEBOUNCE_ROW_DEFER: Report a row DEBOUNCE ms after last bounce on that row.
+ * DEBOUNCE_KEY_EAGER: Report a key on its first edge then ignore it for
+ *      DEBOUNCE ms. No delay on press but needs a counter byte per key.
+ * DEBOUNCE_KEY_DEFER: Report a key after its state is stable for four
+ *      samples taken every DEBOUNCE/3 ms. Counters are bit-sliced across
+ *      rows(vertical counter), two bits of RAM per key.
+ */
+#define DEBOUNCE_GLOBAL_DEFER   0
+#define DEBOUNCE_ROW_DEFER      1
+#define DEBOUNCE_KEY_EAGER      2
+#define DEBOUNCE_KEY_DEFER      3
+
+#ifndef DEBOUNCE_ALGO
+#   define DEBOUNCE_ALGO    DEBOUNCE_GLOBAL_DEFER
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* matrix: debounced state which matrix driver serves with matrix_get_row() */
+void debounce_init(matrix_row_t *matrix);
+/* pass switch state of a row just read, call for every row on each scan */
+void debounce_row(uint8_t row, matrix_row_t raw);
+/* call at end of scan, returns non-zero when debounced matrix has changed */
+uint8_t debounce_update(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
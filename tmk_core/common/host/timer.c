@@ -0,0 +1,51 @@
+#include "timer.h"
+#include "wait.h"
+
+/* Milli second tick count
+ *
+ * There is no timer interrupt on host, the clock is virtual and advanced
+ * explicitly by the host program(and by wait_ms) so that runs are
+ * deterministic.
+ */
+volatile uint32_t timer_count = 0;
+
+void timer_init(void)
+{
+    timer_count = 0;
+}
+
+void timer_clear(void)
+{
+    timer_count = 0;
+}
+
+uint16_t timer_read(void)
+{
+    return (uint16_t)(timer_count & 0xFFFF);
+}
+
+uint32_t timer_read32(void)
+{
+    return timer_count;
+}
+
+uint16_t timer_elapsed(uint16_t last)
+{
+    return TIMER_DIFF_16(timer_read(), last);
+}
+
+uint32_t timer_elapsed32(uint32_t last)
+{
+    return TIMER_DIFF_32(timer_read32(), last);
+}
+
+
+void wait_ms(uint16_t ms)
+{
+    timer_count += ms;
+}
+
+void wait_us(uint16_t us)
+{
+    (void)us;
+}
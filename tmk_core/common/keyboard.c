@@ -28,9 +28,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "sendchar.h"
 #include "bootmagic.h"
+#include "spsc_queue.h"
 #include "eeconfig.h"
 #include "backlight.h"
 #include "hook.h"
+#include "action_macro.h"
+#include "action_util.h"
+#include "action_layer.h"
 #ifdef MOUSEKEY_ENABLE
 #   include "mousekey.h"
 #endif
@@ -45,7 +49,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
-#ifdef MATRIX_HAS_GHOST
+#if defined(MATRIX_HAS_GHOST) && !defined(KEYBOARD_EVENT_QUEUE)
 static bool has_ghost_in_row(uint8_t row)
 {
     matrix_row_t matrix_row = matrix_get_row(row);
@@ -87,26 +91,83 @@ void keyboard_init(void)
     bootmagic();
 #endif
 
+    transparency_map_init();
+
 #ifdef BACKLIGHT_ENABLE
     backlight_init();
 #endif
 }
 
+#ifdef KEYBOARD_EVENT_QUEUE
+#ifdef MATRIX_SCAN_THREAD
+#   error "KEYBOARD_EVENT_QUEUE can't be used with MATRIX_SCAN_THREAD"
+#endif
 /*
- * Do keyboard routine jobs: scan matrix, light LEDs, ...
- * This is repeatedly called as fast as possible.
+ * Key event queue
+ * Converter posts key events in matrix_scan() as it receives make and break
+ * codes, keyboard_task() executes them in order and skips walking matrix.
  */
-void keyboard_task(void)
+#ifndef KEYBOARD_EVENT_QUEUE_SIZE
+#   define KEYBOARD_EVENT_QUEUE_SIZE 8
+#endif
+#if (KEYBOARD_EVENT_QUEUE_SIZE & (KEYBOARD_EVENT_QUEUE_SIZE - 1)) || KEYBOARD_EVENT_QUEUE_SIZE > 256
+#   error "KEYBOARD_EVENT_QUEUE_SIZE must be power of 2 and 256 or less"
+#endif
+
+SPSC_QUEUE(event_queue, keyevent_t, KEYBOARD_EVENT_QUEUE_SIZE)
+
+bool keyboard_event_post(keyevent_t event)
+{
+    if (event_queue_full()) {
+        // execute the oldest event to make room rather than losing it
+        keyevent_t e = event_queue_get();
+        action_exec(e);
+        hook_matrix_change(e);
+    }
+    return event_queue_put(event);
+}
+
+bool keyboard_event_get(keyevent_t *event)
+{
+    if (event_queue_empty()) return false;
+    *event = event_queue_get();
+    return true;
+}
+
+#else
+// set when key event couldn't be posted, it is retried on next scan
+static bool scan_retry = false;
+
+#ifdef MATRIX_SCAN_THREAD
+/*
+ * Scan matrix and post key events to main loop.
+ * This is called at fixed period from scan thread.
+ */
+#define KEY_EVENT(e)    if (!keyboard_event_post(e)) { scan_retry = true; return; }
+/* matrix is printed by main thread, not to print on small stack of scan
+ * thread concurrently with console output of main thread */
+static volatile bool matrix_print_pending = false;
+#define MATRIX_PRINT()  (matrix_print_pending = true)
+void keyboard_scan_task(void)
+#else
+#define KEY_EVENT(e)    do { action_exec(e); hook_matrix_change(e); } while (0)
+#define MATRIX_PRINT()  matrix_print()
+static void keyboard_scan(void)
+#endif
 {
     static matrix_row_t matrix_prev[MATRIX_ROWS];
 #ifdef MATRIX_HAS_GHOST
     static matrix_row_t matrix_ghost[MATRIX_ROWS];
 #endif
-    static uint8_t led_status = 0;
     matrix_row_t matrix_row = 0;
     matrix_row_t matrix_change = 0;
 
+#ifdef MATRIX_SCAN_CHANGED
+    if (!matrix_scan() && !scan_retry) return;
+#else
     matrix_scan();
+#endif
+    scan_retry = false;
     for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
         matrix_row = matrix_get_row(r);
         matrix_change = matrix_row ^ matrix_prev[r];
@@ -118,41 +179,87 @@ void keyboard_task(void)
                  * the last key would be lost.
                  */
                 if (debug_matrix && matrix_ghost[r] != matrix_row) {
-                    matrix_print();
+                    MATRIX_PRINT();
                 }
                 matrix_ghost[r] = matrix_row;
                 continue;
             }
             matrix_ghost[r] = matrix_row;
 #endif
-            if (debug_matrix) matrix_print();
-            matrix_row_t col_mask = 1;
-            for (uint8_t c = 0; c < MATRIX_COLS; c++, col_mask <<= 1) {
-                if (matrix_change & col_mask) {
-                    keyevent_t e = (keyevent_t){
-                        .key = (keypos_t){ .row = r, .col = c },
-                        .pressed = (matrix_row & col_mask),
-                        .time = (timer_read() | 1) /* time should not be 0 */
-                    };
-                    action_exec(e);
-                    hook_matrix_change(e);
-                    // record a processed key
-                    matrix_prev[r] ^= col_mask;
-
-                    // This can miss stroke when scan matrix takes long like Topre
-                    // process a key per task call
-                    //goto MATRIX_LOOP_END;
-                }
+            if (debug_matrix) MATRIX_PRINT();
+            // visit only changed columns from lowest
+            for (; matrix_change; matrix_change &= matrix_change - 1) {
+                uint8_t c = matrix_row_ctz(matrix_change);
+                matrix_row_t col_mask = ((matrix_row_t)1<<c);
+                keyevent_t e = (keyevent_t){
+                    .key = (keypos_t){ .row = r, .col = c },
+                    .pressed = (matrix_row & col_mask),
+                    .time = (timer_read() | 1) /* time should not be 0 */
+                };
+                KEY_EVENT(e);
+                // record a processed key
+                matrix_prev[r] ^= col_mask;
+
+                // This can miss stroke when scan matrix takes long like Topre
+                // process a key per task call
+                //return;
             }
         }
     }
+}
+#endif
+
+/*
+ * Do keyboard routine jobs: scan matrix, light LEDs, ...
+ * This is repeatedly called as fast as possible.
+ */
+void keyboard_task(void)
+{
+    static uint8_t led_status = 0;
+
+    /* Not reentrant: matrix_scan(), actions and hooks called from here must not
+     * call keyboard_task(), converters waiting inside matrix_scan() can only
+     * poll and queue input(see usb_usb). */
+    static bool in_task = false;
+    if (in_task) return;
+    in_task = true;
+
+#if defined(MATRIX_SCAN_THREAD) || defined(KEYBOARD_EVENT_QUEUE)
+#   ifdef KEYBOARD_EVENT_QUEUE
+    // converter posts key events while receiving codes
+    matrix_scan();
+#   endif
+    // key events from scan thread or converter
+    keyevent_t e;
+    while (keyboard_event_get(&e)) {
+        action_exec(e);
+        hook_matrix_change(e);
+    }
+#   ifdef MATRIX_SCAN_THREAD
+    if (matrix_print_pending) {
+        matrix_print_pending = false;
+        matrix_print();
+    }
+#   endif
+#else
+    keyboard_scan();
+#endif
+
     // call with pseudo tick event when no real key event.
     action_exec(TICK);
 
-//MATRIX_LOOP_END:
+#if !defined(NO_ACTION_MACRO) && defined(ACTION_MACRO_ASYNC)
+    // play queued macros
+    action_macro_task();
+#endif
 
     hook_keyboard_loop();
 
+#ifdef REPORT_COALESCE
+    // send changes made in this loop at once
+    flush_keyboard_report();
+#endif
+
 #ifdef MOUSEKEY_ENABLE
     // mousekey repeat & acceleration
     mousekey_task();
@@ -176,6 +283,8 @@ void keyboard_task(void)
         if (debug_keyboard) dprintf("LED: %02X\n", led_status);
         hook_keyboard_leds_change(led_status);
     }
+
+    in_task = false;
 }
 
 void keyboard_set_leds(uint8_t leds)
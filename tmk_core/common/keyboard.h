@@ -50,6 +50,13 @@ static inline bool IS_NOEVENT(keyevent_t event) { return event.time == 0 || (eve
 static inline bool IS_PRESSED(keyevent_t event) { return (!IS_NOEVENT(event) && event.pressed); }
 static inline bool IS_RELEASED(keyevent_t event) { return (!IS_NOEVENT(event) && !event.pressed); }
 
+/* Key event at current time */
+#define KEYEVENT(r, c, p)       (keyevent_t){           \
+    .key = (keypos_t){ .row = (r), .col = (c) },        \
+    .pressed = (p),                                     \
+    .time = (timer_read() | 1)                          \
+}
+
 /* Tick event */
 #define TICK                    (keyevent_t){           \
     .key = (keypos_t){ .row = 255, .col = 255 },           \
@@ -67,6 +74,20 @@ void keyboard_task(void);
 /* it runs when host LED status is updated */
 void keyboard_set_leds(uint8_t leds);
 
+#ifdef MATRIX_SCAN_THREAD
+/* it runs in scan thread at fixed period, key events are posted to main loop */
+void keyboard_scan_task(void);
+#endif
+
+#if defined(MATRIX_SCAN_THREAD) || defined(KEYBOARD_EVENT_QUEUE)
+/* queue key event for main loop, returns false when queue is full
+ * With KEYBOARD_EVENT_QUEUE converter calls this from matrix_scan() on make
+ * and break instead of keyboard_task() finding changes of matrix. */
+bool keyboard_event_post(keyevent_t event);
+/* dequeue key event for main loop, returns false when queue is empty */
+bool keyboard_event_get(keyevent_t *event);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
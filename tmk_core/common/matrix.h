@@ -22,12 +22,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdbool.h>
 
 
+/* matrix_row_ctz(r): index of lowest on-bit in row, undefined when r is 0 */
 #if (MATRIX_COLS <= 8)
 typedef  uint8_t    matrix_row_t;
+#define  matrix_row_ctz(r)  __builtin_ctz(r)
 #elif (MATRIX_COLS <= 16)
 typedef  uint16_t   matrix_row_t;
+#define  matrix_row_ctz(r)  __builtin_ctz(r)
 #elif (MATRIX_COLS <= 32)
 typedef  uint32_t   matrix_row_t;
+#define  matrix_row_ctz(r)  __builtin_ctzl(r)
 #else
 #error "MATRIX_COLS: invalid value"
 #endif
@@ -51,7 +55,9 @@ uint8_t matrix_cols(void);
 void matrix_setup(void);
 /* intialize matrix for scaning. */
 void matrix_init(void);
-/* scan all key states on matrix */
+/* scan all key states on matrix
+ * With MATRIX_SCAN_CHANGED defined it must return 0 when no key state has
+ * changed since last scan, keyboard_task() skips walking rows then. */
 uint8_t matrix_scan(void);
 /* whether modified from previous scan. used after matrix_scan. */
 bool matrix_is_modified(void) __attribute__ ((deprecated));
@@ -104,6 +104,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   define KEYBOARD_REPORT_SIZE NKRO_EPSIZE
 #   define KEYBOARD_REPORT_KEYS (NKRO_EPSIZE - 2)
 #   define KEYBOARD_REPORT_BITS (NKRO_EPSIZE - 1)
+#elif defined(PROTOCOL_HOST) && defined(NKRO_ENABLE)
+#   define KEYBOARD_REPORT_SIZE 32
+#   define KEYBOARD_REPORT_KEYS (32 - 2)
+#   define KEYBOARD_REPORT_BITS (32 - 1)
 
 #else
 #   define KEYBOARD_REPORT_SIZE 8
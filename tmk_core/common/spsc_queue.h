@@ -0,0 +1,99 @@
+/*
+ * Single-producer single-consumer queue
+ *
+ *     SPSC_QUEUE(rbuf, uint8_t, 32)
+ *
+ * defines queue `rbuf` of uint8_t and its functions rbuf_put(), rbuf_get() and
+ * so on. Size should be power of 2 up to 256 and the queue holds size-1
+ * elements.
+ *
+ * One side puts(ISR typically) and the other gets(main loop), each side writes
+ * only its own byte index so that neither side needs to disable interrupts on
+ * single core MCU. Index is published after element is written, elements of
+ * multiple bytes are safe as well. Put on full queue counts up `overflow`
+ * instead of printing in ISR, consumer can check it with name_overflow().
+ */
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* keep compiler from moving element access across index update */
+#define SPSC_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+#define SPSC_QUEUE(name, type, size) \
+typedef char name##_size_check[((size) & ((size) - 1)) == 0 && (size) <= 256 ? 1 : -1]; \
+\
+static struct { \
+    type buf[size]; \
+    volatile uint8_t head;      /* written only by producer */ \
+    volatile uint8_t tail;      /* written only by consumer */ \
+    volatile uint8_t overflow;  /* elements lost on full queue, saturates at 255 */ \
+} name; \
+\
+/* Producer: returns false and counts overflow when full */ \
+static inline bool name##_put(type data) \
+{ \
+    uint8_t head = name.head; \
+    uint8_t next = (uint8_t)(head + 1) & ((size) - 1); \
+    if (next == name.tail) { \
+        if (name.overflow != 0xFF) name.overflow++; \
+        return false; \
+    } \
+    name.buf[head] = data; \
+    SPSC_BARRIER(); \
+    name.head = next; \
+    return true; \
+} \
+static inline bool name##_full(void) \
+{ \
+    return ((uint8_t)(name.head + 1) & ((size) - 1)) == name.tail; \
+} \
+\
+/* Consumer */ \
+static inline bool name##_empty(void) \
+{ \
+    return name.head == name.tail; \
+} \
+static inline uint8_t name##_count(void) \
+{ \
+    return (uint8_t)(name.head - name.tail) & ((size) - 1); \
+} \
+/* returns zero value when empty */ \
+static inline type name##_get(void) \
+{ \
+    static type none;   /* zero initialized */ \
+    uint8_t tail = name.tail; \
+    if (name.head == tail) return none; \
+    type data = name.buf[tail]; \
+    SPSC_BARRIER(); \
+    name.tail = (uint8_t)(tail + 1) & ((size) - 1); \
+    return data; \
+} \
+/* copies up to max elements to dst and releases them at once */ \
+static inline uint8_t name##_drain(type *dst, uint8_t max) \
+{ \
+    uint8_t tail = name.tail; \
+    uint8_t n = (uint8_t)(name.head - tail) & ((size) - 1); \
+    if (n > max) n = max; \
+    for (uint8_t i = 0; i < n; i++) { \
+        dst[i] = name.buf[tail]; \
+        tail = (uint8_t)(tail + 1) & ((size) - 1); \
+    } \
+    SPSC_BARRIER(); \
+    name.tail = tail; \
+    return n; \
+} \
+/* discards elements in queue */ \
+static inline void name##_clear(void) \
+{ \
+    name.tail = name.head; \
+} \
+static inline uint8_t name##_overflow(void) \
+{ \
+    return name.overflow; \
+}
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef WAIT_H
 #define WAIT_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -13,6 +15,9 @@ extern "C" {
 #   include "ch.h"
 #   define wait_ms(ms) chThdSleepMilliseconds(ms)
 #   define wait_us(us) chThdSleepMicroseconds(us)
+#elif defined(PROTOCOL_HOST) /* __AVR__ */
+void wait_ms(uint16_t ms);
+void wait_us(uint16_t us);
 #elif defined(__arm__) /* __AVR__ */
 #   include "wait_api.h"
 #endif /* __AVR__ */
@@ -76,6 +76,72 @@ void hook_usb_suspend_loop(void) {
   }
 }
 
+#ifdef MATRIX_SCAN_THREAD
+/* Matrix scan thread
+ * Matrix is scanned at fixed period in higher priority thread regardless of
+ * how long main loop takes for action and USB. Key events are passed to main
+ * loop through mailbox and main thread is woken up with event flag.
+ */
+#ifndef MATRIX_SCAN_PERIOD_US
+#define MATRIX_SCAN_PERIOD_US     1000
+#endif
+#ifndef MATRIX_EVENT_QUEUE_SIZE
+#define MATRIX_EVENT_QUEUE_SIZE   16
+#endif
+#ifndef MATRIX_SCAN_THREAD_PRIO
+#define MATRIX_SCAN_THREAD_PRIO   (NORMALPRIO + 1)
+#endif
+/* matrix_scan() and debounce run on this stack, matrix debug print is done
+ * by main thread */
+#ifndef MATRIX_SCAN_THREAD_STACK
+#define MATRIX_SCAN_THREAD_STACK  512
+#endif
+#define MATRIX_EVENT_FLAG         EVENT_MASK(0)
+
+static msg_t matrix_event_buf[MATRIX_EVENT_QUEUE_SIZE];
+static MAILBOX_DECL(matrix_event_mb, matrix_event_buf, MATRIX_EVENT_QUEUE_SIZE);
+static thread_t *keyboard_thread;
+
+/* key event is packed into msg: time(16) | pressed(1) | col(7) | row(8) */
+bool keyboard_event_post(keyevent_t event) {
+  msg_t msg = (msg_t)(((uint32_t)event.time << 16) | (event.pressed ? 0x8000 : 0) |
+                      ((event.key.col & 0x7F) << 8) | event.key.row);
+  chSysLock();
+  if(chMBPostI(&matrix_event_mb, msg) != MSG_OK) {
+    chSysUnlock();
+    return false;
+  }
+  chEvtSignalI(keyboard_thread, MATRIX_EVENT_FLAG);
+  chSysUnlock();
+  return true;
+}
+
+bool keyboard_event_get(keyevent_t *event) {
+  msg_t msg;
+  if(chMBFetchTimeout(&matrix_event_mb, &msg, TIME_IMMEDIATE) != MSG_OK) {
+    return false;
+  }
+  *event = (keyevent_t){
+    .key = (keypos_t){ .row = msg & 0xFF, .col = (msg >> 8) & 0x7F },
+    .pressed = (msg & 0x8000),
+    .time = (uint32_t)msg >> 16
+  };
+  return true;
+}
+
+static THD_WORKING_AREA(waMatrixScanThread, MATRIX_SCAN_THREAD_STACK);
+static THD_FUNCTION(matrixScanThread, arg) {
+  (void)arg;
+  chRegSetThreadName("matrixScan");
+  systime_t prev = chVTGetSystemTime();
+  while(true) {
+    keyboard_scan_task();
+    /* sleep until next period, catch up without sleeping when overrun */
+    prev = chThdSleepUntilWindowed(prev, prev + TIME_US2I(MATRIX_SCAN_PERIOD_US));
+  }
+}
+#endif /* MATRIX_SCAN_THREAD */
+
 /* TESTING
  * Amber LED blinker thread, times are in milliseconds.
  */
@@ -141,6 +207,11 @@ int main(void) {
 
   hook_late_init();
 
+#ifdef MATRIX_SCAN_THREAD
+  keyboard_thread = chThdGetSelfX();
+  chThdCreateStatic(waMatrixScanThread, sizeof(waMatrixScanThread), MATRIX_SCAN_THREAD_PRIO, matrixScanThread, NULL);
+#endif
+
   /* Main loop */
   while(true) {
 
@@ -158,5 +229,9 @@ int main(void) {
     }
 
     keyboard_task();
+#ifdef MATRIX_SCAN_THREAD
+    /* sleep until key event comes, wake up every 1ms for tick event */
+    chEvtWaitAnyTimeout(MATRIX_EVENT_FLAG, TIME_MS2I(1));
+#endif
   }
 }
@@ -15,12 +15,15 @@
  * GPL v2 or later.
  */
 
+#include <string.h>
+
 #include "ch.h"
 #include "hal.h"
 
 #include "usb_main.h"
 
 #include "host.h"
+#include "action_util.h"
 #include "debug.h"
 #include "suspend.h"
 #ifdef SLEEP_LED_ENABLE
@@ -58,6 +61,7 @@ uint16_t keyboard_led_stats __attribute__((aligned(2))) = 0;
 volatile uint16_t keyboard_idle_count = 0;
 static virtual_timer_t keyboard_idle_timer;
 static void keyboard_idle_timer_cb(void *arg);
+static void report_pipes_resetI(void);
 #ifdef NKRO_ENABLE
 extern bool keyboard_nkro;
 #endif /* NKRO_ENABLE */
@@ -787,6 +791,9 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
   switch(event) {
   case USB_EVENT_RESET:
     //TODO: from ISR! print("[R]");
+    osalSysLockFromISR();
+    report_pipes_resetI();
+    osalSysUnlockFromISR();
     return;
 
   case USB_EVENT_ADDRESS:
@@ -794,6 +801,8 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
 
   case USB_EVENT_CONFIGURED:
     osalSysLockFromISR();
+    /* transfers of previous configuration are gone */
+    report_pipes_resetI();
     /* Enable the endpoints specified into the configuration. */
     usbInitEndpointI(usbp, KBD_ENDPOINT, &kbd_ep_config);
 #ifdef MOUSE_ENABLE
@@ -1064,19 +1073,89 @@ void send_remote_wakeup(USBDriver *usbp) {
  * ---------------------------------------------------------
  */
 
+/* IN report pipe
+ * Report buffer is double buffered, USB driver reads one while main thread
+ * writes latest state into the other. IN complete callback starts transfer of
+ * the latest state if it has not been sent yet. State published while a
+ * transfer is going supersedes pending one, caller waits for the pending one
+ * to be started first when that would lose a change. Bus reset and
+ * configuration drop pending state and wake the waiting caller.
+ * Functions with I suffix are called in locked state.
+ */
+typedef struct {
+  uint8_t *buf[2];
+  usbep_t ep;
+  uint8_t size;
+  uint8_t fill;       /* buffer main thread writes */
+  bool pending;       /* buf[fill] has state yet to be sent */
+  thread_reference_t waiting;   /* caller waiting for pending one to start */
+} in_pipe_t;
+
+static void in_pipe_startI(in_pipe_t *pipe) {
+  if(!pipe->pending || usbGetTransmitStatusI(&USB_DRIVER, pipe->ep)) {
+    return;
+  }
+  usbStartTransmitI(&USB_DRIVER, pipe->ep, pipe->buf[pipe->fill], pipe->size);
+  pipe->fill ^= 1;
+  pipe->pending = false;
+}
+
+static void in_pipe_publishI(in_pipe_t *pipe, const void *report) {
+  memcpy(pipe->buf[pipe->fill], report, pipe->size);
+  pipe->pending = true;
+  in_pipe_startI(pipe);
+}
+
+static void in_pipe_cb(in_pipe_t *pipe) {
+  osalSysLockFromISR();
+  in_pipe_startI(pipe);
+  osalThreadResumeI(&pipe->waiting, MSG_OK);
+  osalSysUnlockFromISR();
+}
+
+static void in_pipe_resetI(in_pipe_t *pipe) {
+  pipe->fill = 0;
+  pipe->pending = false;
+  osalThreadResumeI(&pipe->waiting, MSG_RESET);
+}
+
+/* waits until pending state is started, returns false when USB is not active
+ * not callable from ISR, called in locked state */
+static bool in_pipe_waitS(in_pipe_t *pipe) {
+  if(!usbGetTransmitStatusI(&USB_DRIVER, pipe->ep)) {
+    /* no transfer whose IN callback would start it */
+    in_pipe_startI(pipe);
+    return true;
+  }
+  osalThreadSuspendS(&pipe->waiting);
+  return usbGetDriverStateI(&USB_DRIVER) == USB_ACTIVE;
+}
+
+static report_keyboard_t kbd_buf[2];
+static in_pipe_t kbd_pipe = {
+  { (uint8_t *)&kbd_buf[0], (uint8_t *)&kbd_buf[1] }, KBD_ENDPOINT, KBD_EPSIZE, 0, false, NULL
+};
+
+#ifdef NKRO_ENABLE
+static report_keyboard_t nkro_buf[2];
+static in_pipe_t nkro_pipe = {
+  { (uint8_t *)&nkro_buf[0], (uint8_t *)&nkro_buf[1] }, NKRO_ENDPOINT, sizeof(report_keyboard_t), 0, false, NULL
+};
+#endif /* NKRO_ENABLE */
+
 /* keyboard IN callback hander (a kbd report has made it IN) */
 void kbd_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
   (void)usbp;
   (void)ep;
+  in_pipe_cb(&kbd_pipe);
 }
 
 #ifdef NKRO_ENABLE
 /* nkro IN callback hander (a nkro report has made it IN) */
 void nkro_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
   (void)usbp;
   (void)ep;
+  in_pipe_cb(&nkro_pipe);
 }
 #endif /* NKRO_ENABLE */
 
@@ -1108,7 +1187,7 @@ static void keyboard_idle_timer_cb(void *arg) {
 #endif /* NKRO_ENABLE */
     /* TODO: are we sure we want the KBD_ENDPOINT? */
     if(!usbGetTransmitStatusI(usbp, KBD_ENDPOINT)) {
-      usbStartTransmitI(usbp, KBD_ENDPOINT, (uint8_t *)&keyboard_report_sent, KBD_EPSIZE);
+      in_pipe_publishI(&kbd_pipe, &keyboard_report_sent);
     }
     /* rearm the timer */
     chVTSetI(&keyboard_idle_timer, 4*TIME_MS2I(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
@@ -1124,7 +1203,7 @@ uint8_t keyboard_leds(void) {
   return (uint8_t)(keyboard_led_stats & 0xFF);
 }
 
-/* prepare and start sending a report IN
+/* publish keyboard state, transfer is started by IN callback if endpoint is busy
  * not callable from ISR or locked state */
 void send_keyboard(report_keyboard_t *report) {
   osalSysLock();
@@ -1132,42 +1211,28 @@ void send_keyboard(report_keyboard_t *report) {
     osalSysUnlock();
     return;
   }
-  osalSysUnlock();
 
+  in_pipe_t *pipe = &kbd_pipe;    /* boot protocol */
 #ifdef NKRO_ENABLE
   if(keyboard_nkro) {  /* NKRO protocol */
-    /* need to wait until the previous packet has made it through */
-    /* can rewrite this using the synchronous API, then would wait
-     * until *after* the packet has been transmitted. I think
-     * this is more efficient */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, NKRO_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[NKRO_ENDPOINT]->in_state->thread);
-    }
-    usbStartTransmitI(&USB_DRIVER, NKRO_ENDPOINT, (uint8_t *)report, sizeof(report_keyboard_t));
-    osalSysUnlock();
-  } else
+    pipe = &nkro_pipe;
+  }
 #endif /* NKRO_ENABLE */
-  { /* boot protocol */
-    /* need to wait until the previous packet has made it through */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, KBD_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[KBD_ENDPOINT]->in_state->thread);
+
+  /* pending report is superseded only when no key press or release is lost,
+   * otherwise wait until it is started. */
+  while(pipe->pending &&
+        keyboard_report_needs_flush((report_keyboard_t *)pipe->buf[pipe->fill ^ 1],
+                                    (report_keyboard_t *)pipe->buf[pipe->fill], report)) {
+    if(!in_pipe_waitS(pipe)) {
+      osalSysUnlock();
+      return;
     }
-    usbStartTransmitI(&USB_DRIVER, KBD_ENDPOINT, (uint8_t *)report, KBD_EPSIZE);
-    osalSysUnlock();
   }
+
   keyboard_report_sent = *report;
+  in_pipe_publishI(pipe, report);
+  osalSysUnlock();
 }
 
 /* ---------------------------------------------------------
@@ -1177,10 +1242,21 @@ void send_keyboard(report_keyboard_t *report) {
 
 #ifdef MOUSE_ENABLE
 
+static report_mouse_t mouse_buf[2];
+static in_pipe_t mouse_pipe = {
+  { (uint8_t *)&mouse_buf[0], (uint8_t *)&mouse_buf[1] }, MOUSE_ENDPOINT, sizeof(report_mouse_t), 0, false, NULL
+};
+
 /* mouse IN callback hander (a mouse report has made it IN) */
 void mouse_in_cb(USBDriver *usbp, usbep_t ep) {
   (void)usbp;
   (void)ep;
+  in_pipe_cb(&mouse_pipe);
+}
+
+static int8_t mouse_add(int8_t a, int8_t b) {
+  int16_t v = a + b;
+  return (v > 127 ? 127 : (v < -127 ? -127 : v));
 }
 
 void send_mouse(report_mouse_t *report) {
@@ -1189,15 +1265,17 @@ void send_mouse(report_mouse_t *report) {
     osalSysUnlock();
     return;
   }
-  osalSysUnlock();
 
-  /* TODO: LUFA manually waits for the endpoint to become ready
-   * for about 10ms for mouse, kbd, system; 1ms for nkro
-   * is this really needed?
-   */
-
-  osalSysLock();
-  usbStartTransmitI(&USB_DRIVER, MOUSE_ENDPOINT, (uint8_t *)report, sizeof(report_mouse_t));
+  /* movement is relative, add it to report not yet sent instead of dropping */
+  report_mouse_t r = *report;
+  if(mouse_pipe.pending) {
+    report_mouse_t *p = &mouse_buf[mouse_pipe.fill];
+    r.x = mouse_add(p->x, r.x);
+    r.y = mouse_add(p->y, r.y);
+    r.v = mouse_add(p->v, r.v);
+    r.h = mouse_add(p->h, r.h);
+  }
+  in_pipe_publishI(&mouse_pipe, &r);
   osalSysUnlock();
 }
 
@@ -1214,11 +1292,31 @@ void send_mouse(report_mouse_t *report) {
 
 #ifdef EXTRAKEY_ENABLE
 
+/* System and consumer reports share the endpoint, pending state of each
+ * is kept so that one doesn't supersede the other. */
+static report_extra_t extra_buf;
+static report_extra_t extra_pending[2];
+static uint8_t extra_pending_bits = 0;
+static thread_reference_t extra_waiting = NULL;
+
+static void extra_startI(void) {
+  if(!extra_pending_bits || usbGetTransmitStatusI(&USB_DRIVER, EXTRA_ENDPOINT)) {
+    return;
+  }
+  uint8_t i = (extra_pending_bits & 1) ? 0 : 1;
+  extra_buf = extra_pending[i];
+  extra_pending_bits &= ~(1 << i);
+  usbStartTransmitI(&USB_DRIVER, EXTRA_ENDPOINT, (uint8_t *)&extra_buf, sizeof(report_extra_t));
+}
+
 /* extrakey IN callback hander */
 void extra_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
   (void)usbp;
   (void)ep;
+  osalSysLockFromISR();
+  extra_startI();
+  osalThreadResumeI(&extra_waiting, MSG_OK);
+  osalSysUnlockFromISR();
 }
 
 static void send_extra_report(uint8_t report_id, uint16_t data) {
@@ -1228,12 +1326,25 @@ static void send_extra_report(uint8_t report_id, uint16_t data) {
     return;
   }
 
-  report_extra_t report = {
+  uint8_t i = (report_id == REPORT_ID_SYSTEM) ? 0 : 1;
+  /* pending usage would be lost, wait until it is started */
+  while(extra_pending_bits & (1 << i)) {
+    if(!usbGetTransmitStatusI(&USB_DRIVER, EXTRA_ENDPOINT)) {
+      extra_startI();
+      continue;
+    }
+    osalThreadSuspendS(&extra_waiting);
+    if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
+      osalSysUnlock();
+      return;
+    }
+  }
+  extra_pending[i] = (report_extra_t){
     .report_id = report_id,
     .usage = data
   };
-
-  usbStartTransmitI(&USB_DRIVER, EXTRA_ENDPOINT, (uint8_t *)&report, sizeof(report_extra_t));
+  extra_pending_bits |= (1 << i);
+  extra_startI();
   osalSysUnlock();
 }
 
@@ -1254,6 +1365,22 @@ void send_consumer(uint16_t data) {
 }
 #endif /* EXTRAKEY_ENABLE */
 
+/* drop report state of aborted transfers on bus reset and configuration
+ * called from ISR in locked state */
+static void report_pipes_resetI(void) {
+  in_pipe_resetI(&kbd_pipe);
+#ifdef NKRO_ENABLE
+  in_pipe_resetI(&nkro_pipe);
+#endif /* NKRO_ENABLE */
+#ifdef MOUSE_ENABLE
+  in_pipe_resetI(&mouse_pipe);
+#endif /* MOUSE_ENABLE */
+#ifdef EXTRAKEY_ENABLE
+  extra_pending_bits = 0;
+  osalThreadResumeI(&extra_waiting, MSG_RESET);
+#endif /* EXTRAKEY_ENABLE */
+}
+
 /* ---------------------------------------------------------
  *                   Console functions
  * ---------------------------------------------------------
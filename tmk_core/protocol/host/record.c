@@ -0,0 +1,91 @@
+#include <stddef.h>
+#include "timer.h"
+#include "host.h"
+#include "record.h"
+
+
+static uint8_t keyboard_leds(void);
+static void send_keyboard(report_keyboard_t *report);
+static void send_mouse(report_mouse_t *report);
+static void send_system(uint16_t data);
+static void send_consumer(uint16_t data);
+
+host_driver_t host_record_driver = {
+    keyboard_leds,
+    send_keyboard,
+    send_mouse,
+    send_system,
+    send_consumer
+};
+
+/* report protocol, NKRO is available with NKRO_ENABLE */
+uint8_t keyboard_protocol = 1;
+
+static host_record_t records[HOST_RECORD_SIZE];
+static uint16_t keyboard_count = 0;
+static uint16_t mouse_count = 0;
+static uint16_t system_count = 0;
+static uint16_t consumer_count = 0;
+static uint8_t leds = 0;
+
+
+void host_record_clear(void)
+{
+    keyboard_count = 0;
+    mouse_count = 0;
+    system_count = 0;
+    consumer_count = 0;
+}
+
+void host_record_set_leds(uint8_t l)
+{
+    leds = l;
+}
+
+uint16_t host_record_count(void)
+{
+    return keyboard_count;
+}
+
+host_record_t *host_record_get(uint16_t index)
+{
+    if (index >= keyboard_count || index >= HOST_RECORD_SIZE) return NULL;
+    return &records[index];
+}
+
+uint16_t host_record_mouse_count(void)    { return mouse_count; }
+uint16_t host_record_system_count(void)   { return system_count; }
+uint16_t host_record_consumer_count(void) { return consumer_count; }
+
+
+static uint8_t keyboard_leds(void)
+{
+    return leds;
+}
+
+static void send_keyboard(report_keyboard_t *report)
+{
+    if (keyboard_count < HOST_RECORD_SIZE) {
+        records[keyboard_count].time = timer_read32();
+        records[keyboard_count].keyboard = *report;
+    }
+    if (keyboard_count < UINT16_MAX) keyboard_count++;
+}
+
+static void send_mouse(report_mouse_t *report)
+{
+    (void)report;
+    mouse_count++;
+}
+
+static void send_system(uint16_t data)
+{
+    (void)data;
+    system_count++;
+}
+
+static void send_consumer(uint16_t data)
+{
+    (void)data;
+    consumer_count++;
+}
@@ -0,0 +1,46 @@
+#ifndef HOST_RECORD_H
+#define HOST_RECORD_H
+
+#include <stdint.h>
+#include "report.h"
+#include "host_driver.h"
+
+
+/* Recording host driver
+ *
+ * Stores every report sent by the core instead of transmitting it so that
+ * a host program can inspect what and when the keyboard would have sent.
+ */
+#ifndef HOST_RECORD_SIZE
+#define HOST_RECORD_SIZE    256
+#endif
+
+typedef struct {
+    uint32_t time;                  /* timer_read32() at sending */
+    report_keyboard_t keyboard;
+} host_record_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern host_driver_t host_record_driver;
+
+void host_record_clear(void);
+void host_record_set_leds(uint8_t leds);
+
+/* number of keyboard reports sent since last clear(including dropped) */
+uint16_t host_record_count(void);
+/* recorded keyboard report, NULL when out of range or dropped */
+host_record_t *host_record_get(uint16_t index);
+
+uint16_t host_record_mouse_count(void);
+uint16_t host_record_system_count(void);
+uint16_t host_record_consumer_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,7 +4,7 @@ Copyright 2010,2011,2012,2013 Jun WAKO <wakojun@gmail.com>
 #include <stdbool.h>
 #include <util/delay.h>
 #include "debug.h"
-#include "ring_buffer.h"
+#include "spsc_queue.h"
 #include "ibm4704.h"
 
 
@@ -18,6 +18,9 @@ Copyright 2010,2011,2012,2013 Jun WAKO <wakojun@gmail.com>
 
 uint8_t ibm4704_error = 0;
 
+/* scan codes from keyboard */
+SPSC_QUEUE(rbuf, uint8_t, 32)
+
 
 void ibm4704_init(void)
 {
@@ -99,16 +102,16 @@ ERROR:
 /* wait forever to receive data */
 uint8_t ibm4704_recv_response(void)
 {
-    while (!rbuf_has_data()) {
+    while (rbuf_empty()) {
         _delay_ms(1);
     }
-    return rbuf_dequeue();
+    return rbuf_get();
 }
 
 uint8_t ibm4704_recv(void)
 {
-    if (rbuf_has_data()) {
-        return rbuf_dequeue();
+    if (!rbuf_empty()) {
+        return rbuf_get();
     } else {
         return -1;
     }
@@ -167,7 +170,7 @@ ISR(IBM4704_INT_VECT)
         case STOP:
             // Data:Low
             WAIT(data_lo, 100, state);
-            rbuf_enqueue(data);
+            rbuf_put(data);
             ibm4704_error = IBM4704_ERR_NONE;
             goto DONE;
             break;
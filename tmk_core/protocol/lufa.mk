@@ -55,6 +55,12 @@ ifeq (yes,$(strip $(TMK_LUFA_DEBUG)))
     TMK_LUFA_OPTS += -DTMK_LUFA_DEBUG
 endif
 
+# Drain queued keyboard reports on SOF interrupt instead of from main loop.
+# This adds 1kHz interrupt, do not enable it for converters which requires ISR in particular.
+ifeq (yes,$(strip $(TMK_LUFA_SOF_FLUSH)))
+    TMK_LUFA_OPTS += -DTMK_LUFA_SOF_FLUSH
+endif
+
 ifeq (yes,$(strip $(TMK_LUFA_DEBUG_SUART)))
     SRC += common/avr/suart.S
     TMK_LUFA_OPTS += -DTMK_LUFA_DEBUG_SUART
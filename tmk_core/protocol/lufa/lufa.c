@@ -41,9 +41,10 @@
 #include "host_driver.h"
 #include "keyboard.h"
 #include "action.h"
+#include "action_util.h"
 #include "led.h"
 #include "sendchar.h"
-#include "ringbuf.h"
+#include "spsc_queue.h"
 #include "debug.h"
 #ifdef SLEEP_LED_ENABLE
 #include "sleep_led.h"
@@ -75,6 +76,21 @@ static uint8_t keyboard_led_stats = 0;
 
 static report_keyboard_t keyboard_report_sent;
 
+/* Keyboard report queue
+ * send_keyboard() queues report and returns without waiting for endpoint,
+ * queue is drained when endpoint bank is free from main loop, or on SOF
+ * interrupt with TMK_LUFA_SOF_FLUSH. Newest queued report is replaced only
+ * when no key press or release is lost by that, otherwise send_keyboard()
+ * waits for endpoint around 10ms when queue is full as it used to.
+ */
+#ifndef KEYBOARD_REPORT_QUEUE_SIZE
+#define KEYBOARD_REPORT_QUEUE_SIZE  4
+#endif
+static report_keyboard_t keyboard_report_queue[KEYBOARD_REPORT_QUEUE_SIZE];
+static uint8_t keyboard_report_queue_tail = 0;
+static uint8_t keyboard_report_queue_count = 0;
+static void keyboard_report_flush(void);
+
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
@@ -96,13 +112,7 @@ host_driver_t lufa_driver = {
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
 #define SENDBUF_SIZE 256
-static uint8_t sbuf[SENDBUF_SIZE];
-static ringbuf_t sendbuf = {
-    .buffer = sbuf,
-    .head = 0,
-    .tail = 0,
-    .size_mask = SENDBUF_SIZE - 1
-};
+SPSC_QUEUE(sendbuf, uint8_t, SENDBUF_SIZE)
 
 // TODO: Around 2500ms delay often works anyhoo but proper startup would be better
 // 1000ms delay of hid_listen affects this probably
@@ -124,10 +134,10 @@ static bool console_putc(uint8_t c)
     if (!(SREG & (1<<SREG_I)))
         goto EXIT;
 
-    if (USB_DeviceState != DEVICE_STATE_Configured && !ringbuf_is_full(&sendbuf))
+    if (USB_DeviceState != DEVICE_STATE_Configured && !sendbuf_full())
         goto EXIT;
 
-    if (!console_is_ready() && !ringbuf_is_full(&sendbuf))
+    if (!console_is_ready() && !sendbuf_full())
         goto EXIT;
 
     /* Data lost considerations:
@@ -153,8 +163,8 @@ AGAIN:
     }
 
     // write from buffer to endpoint bank
-    while (!ringbuf_is_empty(&sendbuf) && Endpoint_IsReadWriteAllowed()) {
-        Endpoint_Write_8(ringbuf_get(&sendbuf));
+    while (!sendbuf_empty() && Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_8(sendbuf_get());
 
         // clear bank when it is full
         if (!Endpoint_IsReadWriteAllowed() && Endpoint_IsINReady()) {
@@ -164,7 +174,7 @@ AGAIN:
     }
 
     // write c to bank directly if there is no others in buffer
-    if (ringbuf_is_empty(&sendbuf) && Endpoint_IsReadWriteAllowed()) {
+    if (sendbuf_empty() && Endpoint_IsReadWriteAllowed()) {
         Endpoint_Write_8(c);
         done = true;
     }
@@ -188,7 +198,7 @@ AGAIN:
      * once timeout this is disabled until host receives actually,
      * otherwise this will block or make main loop execution sluggish.
      */
-    if (ringbuf_is_full(&sendbuf) && timeout) {
+    if (sendbuf_full() && timeout) {
         uint16_t curr = timer_read();
         if (curr != prev) {
             timeout--;
@@ -200,7 +210,7 @@ AGAIN:
 EXIT_RESTORE_EP:
     Endpoint_SelectEndpoint(ep);
 EXIT:
-    return ringbuf_put(&sendbuf, c);
+    return sendbuf_put(c);
 }
 
 static void console_flush(void)
@@ -220,8 +230,8 @@ static void console_flush(void)
     }
 
     // write from buffer to endpoint bank
-    while (!ringbuf_is_empty(&sendbuf) && Endpoint_IsReadWriteAllowed()) {
-        Endpoint_Write_8(ringbuf_get(&sendbuf));
+    while (!sendbuf_empty() && Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_8(sendbuf_get());
 
         // clear bank when it is full
         if (!Endpoint_IsReadWriteAllowed() && Endpoint_IsINReady()) {
@@ -358,7 +368,21 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     ConfigSuccess &= ENDPOINT_CONFIG(NKRO_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      NKRO_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
+
+#ifdef TMK_LUFA_SOF_FLUSH
+    /* Drain keyboard report queue on SOF */
+    USB_Device_EnableSOFEvents();
+#endif
+}
+
+#ifdef TMK_LUFA_SOF_FLUSH
+/** Event handler for the USB_StartOfFrame event, called every 1ms in ISR.
+ */
+void EVENT_USB_Device_StartOfFrame(void)
+{
+    keyboard_report_flush();
 }
+#endif
 
 /*
 Appendix G: HID Request Support Requirements
@@ -507,44 +531,88 @@ static uint8_t keyboard_leds(void)
     return keyboard_led_stats;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+/* write queued reports while endpoint can take them, call with interrupt disabled */
+static void keyboard_report_flush(void)
 {
-    uint8_t timeout = 128;
+    if (!keyboard_report_queue_count) return;
 
-    if (USB_DeviceState != DEVICE_STATE_Configured)
+    if (USB_DeviceState != DEVICE_STATE_Configured) {
+        keyboard_report_queue_count = 0;
         return;
+    }
 
-    /* Select the Keyboard Report Endpoint */
-#ifdef NKRO_ENABLE
-    if (keyboard_protocol && keyboard_nkro) {
-        /* Report protocol - NKRO */
-        Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    while (keyboard_report_queue_count) {
+        report_keyboard_t *report = &keyboard_report_queue[keyboard_report_queue_tail];
 
-        /* Check if write ready for a polling interval around 1ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(8);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+        /* Select the Keyboard Report Endpoint */
+#ifdef NKRO_ENABLE
+        if (keyboard_protocol && keyboard_nkro) {
+            /* Report protocol - NKRO */
+            Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
+            if (!Endpoint_IsReadWriteAllowed()) break;
 
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
-    }
-    else
+            /* Write Keyboard Report Data */
+            Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
+        }
+        else
 #endif
-    {
-        /* Boot protocol */
-        Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
+        {
+            /* Boot protocol */
+            Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
+            if (!Endpoint_IsReadWriteAllowed()) break;
 
-        /* Check if write ready for a polling interval around 10ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(80);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+            /* Write Keyboard Report Data */
+            Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
+        }
 
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
+        /* Finalize the stream transfer to send the last packet */
+        Endpoint_ClearIN();
+
+        keyboard_report_sent = *report;
+        keyboard_report_queue_tail = (keyboard_report_queue_tail + 1) % KEYBOARD_REPORT_QUEUE_SIZE;
+        keyboard_report_queue_count--;
     }
+    Endpoint_SelectEndpoint(ep);
+}
 
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+static void send_keyboard(report_keyboard_t *report)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t sreg = SREG;
+    cli();
+    keyboard_report_flush();
+    if (keyboard_report_queue_count) {
+        /* replace newest queued report if it loses no change */
+        uint8_t last = (keyboard_report_queue_tail + keyboard_report_queue_count - 1) % KEYBOARD_REPORT_QUEUE_SIZE;
+        report_keyboard_t *prev = (keyboard_report_queue_count > 1) ?
+            &keyboard_report_queue[(last + KEYBOARD_REPORT_QUEUE_SIZE - 1) % KEYBOARD_REPORT_QUEUE_SIZE] :
+            &keyboard_report_sent;
+        if (!keyboard_report_needs_flush(prev, &keyboard_report_queue[last], report)) {
+            keyboard_report_queue[last] = *report;
+            SREG = sreg;
+            return;
+        }
+    }
 
-    keyboard_report_sent = *report;
+    /* Check if queue has room for a polling interval around 10ms */
+    uint8_t timeout = 128;
+    while (timeout-- && keyboard_report_queue_count == KEYBOARD_REPORT_QUEUE_SIZE) {
+        SREG = sreg;
+        _delay_us(80);
+        cli();
+        keyboard_report_flush();
+    }
+    if (keyboard_report_queue_count == KEYBOARD_REPORT_QUEUE_SIZE) {
+        /* host doesn't poll, keep final state at least */
+        keyboard_report_queue_count--;
+    }
+    keyboard_report_queue[(keyboard_report_queue_tail + keyboard_report_queue_count) % KEYBOARD_REPORT_QUEUE_SIZE] = *report;
+    keyboard_report_queue_count++;
+    keyboard_report_flush();
+    SREG = sreg;
 }
 
 static void send_mouse(report_mouse_t *report)
@@ -714,6 +782,12 @@ int main(void)
 
         keyboard_task();
 
+#ifndef TMK_LUFA_SOF_FLUSH
+        cli();
+        keyboard_report_flush();
+        sei();
+#endif
+
 #ifdef CONSOLE_ENABLE
         console_task();
 #endif
@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "news.h"
+#include "spsc_queue.h"
 
 
 void news_init(void)
@@ -47,31 +48,17 @@ void news_init(void)
 }
 
 // RX ring buffer
-#define RBUF_SIZE   8
-static uint8_t rbuf[RBUF_SIZE];
-static uint8_t rbuf_head = 0;
-static uint8_t rbuf_tail = 0;
+SPSC_QUEUE(rbuf, uint8_t, 8)
 
 uint8_t news_recv(void)
 {
-    uint8_t data = 0;
-    if (rbuf_head == rbuf_tail) {
-        return 0;
-    }
-
-    data = rbuf[rbuf_tail];
-    rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
-    return data;
+    return rbuf_get();
 }
 
 // USART RX complete interrupt
 ISR(NEWS_KBD_RX_VECT)
 {
-    uint8_t next = (rbuf_head + 1) % RBUF_SIZE;
-    if (next != rbuf_tail) {
-        rbuf[rbuf_head] = NEWS_KBD_RX_DATA;
-        rbuf_head = next;
-    }
+    rbuf_put(NEWS_KBD_RX_DATA);
 }
 
 
@@ -679,6 +679,7 @@ ISR(USB_GEN_vect)
 		UECFG1X = EP_SIZE(ENDPOINT0_SIZE) | EP_SINGLE_BUFFER;
 		UEIENX = (1<<RXSTPE);
 		usb_configuration = 0;
+		usb_keyboard_clear_queue();
         }
 	if ((intbits & (1<<SOFI)) && usb_configuration) {
 		t = debug_flush_timer;
@@ -692,6 +693,7 @@ ISR(USB_GEN_vect)
 				UEINTX = 0x3A;
 			}
 		}
+		usb_keyboard_flush();
                 /* TODO: should keep IDLE rate on each keyboard interface */
 #ifdef NKRO_ENABLE
 		if (!keyboard_nkro && keyboard_idle && (++div4 & 3) == 0) {
@@ -822,6 +824,7 @@ ISR(USB_COM_vect)
 		}
 		if (bRequest == SET_CONFIGURATION && bmRequestType == 0) {
 			usb_configuration = wValue;
+			usb_keyboard_clear_queue();
 			usb_send_in();
 			cfg = endpoint_config_table;
 			for (i=1; i<=MAX_ENDPOINT; i++) {
@@ -29,6 +29,7 @@
 #include "debug.h"
 #include "util.h"
 #include "host.h"
+#include "action_util.h"
 
 
 // protocol setting from the host.  We use exactly the same report
@@ -48,28 +49,100 @@ uint8_t usb_keyboard_idle_count=0;
 volatile uint8_t usb_keyboard_leds=0;
 
 
+/* Report queue
+ * usb_keyboard_send_report() queues report and returns without waiting for
+ * endpoint, queue is drained when endpoint bank is free on SOF interrupt.
+ * Newest queued report is replaced only when no key press or release is lost
+ * by that, otherwise it waits up to 50 frames when queue is full as it used to
+ * and then overwrites the newest queued report so that current key state is
+ * never dropped.
+ */
+#ifndef USB_KEYBOARD_QUEUE_SIZE
+#define USB_KEYBOARD_QUEUE_SIZE 4
+#endif
+static report_keyboard_t report_queue[USB_KEYBOARD_QUEUE_SIZE];
+static uint8_t report_queue_tail = 0;
+static uint8_t report_queue_count = 0;
+static report_keyboard_t report_sent;
+
 static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end);
 
 
 int8_t usb_keyboard_send_report(report_keyboard_t *report)
 {
-    int8_t result = 0;
+    uint8_t intr_state, timeout;
 
-#ifdef NKRO_ENABLE
-    if (keyboard_nkro)
-        result = send_report(report, KBD2_ENDPOINT, 0, KBD2_SIZE);
-    else
-#endif
-    {
-        result = send_report(report, KBD_ENDPOINT, 0, KBD_SIZE);
+    if (!usb_configured()) return -1;
+    intr_state = SREG;
+    cli();
+    usb_keyboard_flush();
+    if (report_queue_count) {
+        // replace newest queued report if it loses no change
+        uint8_t last = (report_queue_tail + report_queue_count - 1) % USB_KEYBOARD_QUEUE_SIZE;
+        report_keyboard_t *prev = (report_queue_count > 1) ?
+            &report_queue[(last + USB_KEYBOARD_QUEUE_SIZE - 1) % USB_KEYBOARD_QUEUE_SIZE] :
+            &report_sent;
+        if (!keyboard_report_needs_flush(prev, &report_queue[last], report)) {
+            report_queue[last] = *report;
+            SREG = intr_state;
+            usb_keyboard_print_report(report);
+            return 0;
+        }
+    }
+
+    timeout = UDFNUML + 50;
+    while (report_queue_count == USB_KEYBOARD_QUEUE_SIZE) {
+        SREG = intr_state;
+        // has the USB gone offline?
+        if (!usb_configured()) return -1;
+        intr_state = SREG;
+        cli();
+        usb_keyboard_flush();
+        // have we waited too long? overwrite newest queued report
+        if (report_queue_count == USB_KEYBOARD_QUEUE_SIZE && UDFNUML == timeout) {
+            report_queue_count--;
+            break;
+        }
     }
+    report_queue[(report_queue_tail + report_queue_count) % USB_KEYBOARD_QUEUE_SIZE] = *report;
+    report_queue_count++;
+    usb_keyboard_flush();
+    SREG = intr_state;
 
-    if (result) return result;
-    usb_keyboard_idle_count = 0;
     usb_keyboard_print_report(report);
     return 0;
 }
 
+// send queued reports while endpoint is ready, call with interrupt disabled
+void usb_keyboard_flush(void)
+{
+    while (report_queue_count) {
+        int8_t result;
+        report_keyboard_t *report = &report_queue[report_queue_tail];
+#ifdef NKRO_ENABLE
+        if (keyboard_nkro)
+            result = send_report(report, KBD2_ENDPOINT, 0, KBD2_SIZE);
+        else
+#endif
+        {
+            result = send_report(report, KBD_ENDPOINT, 0, KBD_SIZE);
+        }
+        if (result) return;
+
+        report_sent = *report;
+        usb_keyboard_idle_count = 0;
+        report_queue_tail = (report_queue_tail + 1) % USB_KEYBOARD_QUEUE_SIZE;
+        report_queue_count--;
+    }
+}
+
+// discard queued reports, call on bus reset and configuration
+void usb_keyboard_clear_queue(void)
+{
+    report_queue_tail = 0;
+    report_queue_count = 0;
+}
+
 void usb_keyboard_print_report(report_keyboard_t *report)
 {
     if (!debug_keyboard) return;
@@ -81,30 +154,13 @@ void usb_keyboard_print_report(report_keyboard_t *report)
 
 static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end)
 {
-    uint8_t intr_state, timeout;
-
     if (!usb_configured()) return -1;
-    intr_state = SREG;
-    cli();
     UENUM = endpoint;
-    timeout = UDFNUML + 50;
-    while (1) {
-            // are we ready to transmit?
-            if (UEINTX & (1<<RWAL)) break;
-            SREG = intr_state;
-            // has the USB gone offline?
-            if (!usb_configured()) return -1;
-            // have we waited too long?
-            if (UDFNUML == timeout) return -1;
-            // get ready to try checking again
-            intr_state = SREG;
-            cli();
-            UENUM = endpoint;
-    }
+    // are we ready to transmit?
+    if (!(UEINTX & (1<<RWAL))) return -1;
     for (uint8_t i = keys_start; i < keys_end; i++) {
             UEDATX = report->raw[i];
     }
     UEINTX = 0x3A;
-    SREG = intr_state;
     return 0;
 }
@@ -35,6 +35,8 @@ extern volatile uint8_t usb_keyboard_leds;
 
 
 int8_t usb_keyboard_send_report(report_keyboard_t *report);
+void usb_keyboard_flush(void);
+void usb_keyboard_clear_queue(void);
 void usb_keyboard_print_report(report_keyboard_t *report);
 
 #endif
@@ -42,10 +42,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdbool.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
-#include "pbuff.h"
 #include "ps2.h"
 #include "ps2_io.h"
 #include "print.h"
+#include "spsc_queue.h"
 
 
 #define WAIT(stat, us, err) do { \
@@ -58,6 +58,9 @@ POSSIBILITY OF SUCH DAMAGE.
 
 uint8_t ps2_error = PS2_ERR_NONE;
 
+/* scan codes from keyboard */
+SPSC_QUEUE(pbuf, uint8_t, 32)
+
 void ps2_host_init(void)
 {
     idle();
@@ -127,18 +130,18 @@ uint8_t ps2_host_recv_response(void)
 {
     // Command may take 25ms/20ms at most([5]p.46, [3]p.21)
     uint8_t retry = 25;
-    while (retry-- && !pbuf_has_data()) {
+    while (retry-- && pbuf_empty()) {
         _delay_ms(1);
     }
-    return pbuf_dequeue();
+    return pbuf_get();
 }
 
 /* get data received by interrupt */
 uint8_t ps2_host_recv(void)
 {
-    if (pbuf_has_data()) {
+    if (!pbuf_empty()) {
         ps2_error = PS2_ERR_NONE;
-        return pbuf_dequeue();
+        return pbuf_get();
     } else {
         ps2_error = PS2_ERR_NODATA;
         return 0;
@@ -196,7 +199,7 @@ ISR(PS2_INT_VECT)
         case STOP:
             if (!data_in())
                 goto ERROR;
-            pbuf_enqueue(data);
+            pbuf_put(data);
             goto DONE;
             break;
         default:
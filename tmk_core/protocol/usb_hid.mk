@@ -12,6 +12,12 @@ USB_HOST_SHIELD_SRC = \
 	$(USB_HOST_SHIELD_DIR)/parsetools.cpp \
 	$(USB_HOST_SHIELD_DIR)/message.cpp 
 
+# Report protocol keyboard with decoder compiled from report descriptor
+ifeq (yes,$(strip $(USB_HID_REPORT_ENABLE)))
+    USB_HOST_SHIELD_SRC += $(USB_HOST_SHIELD_DIR)/hiduniversal.cpp
+    SRC += $(USB_HID_DIR)/hid_prog.c
+    OPT_DEFS += -DUSB_HID_REPORT_ENABLE
+endif
 
 
 #
@@ -0,0 +1,172 @@
+/*
+ * Host check of HID report descriptor compiler
+ *
+ * Descriptors of typical keyboards are compiled and their reports are
+ * decoded into usage bitmap, results are checked with assert().
+ */
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "hid_prog.h"
+
+
+static bool usage_on(const uint16_t *usage, uint8_t code)
+{
+    return usage[code >> 4] & (1 << (code & 0x0F));
+}
+
+static uint8_t usage_count(const uint16_t *usage)
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < HID_PROG_USAGE_WORDS; i++) {
+        n += __builtin_popcount(usage[i]);
+    }
+    return n;
+}
+
+static void compile(hid_prog_t *prog, uint8_t iface, const uint8_t *desc, uint16_t len)
+{
+    hid_desc_t d;
+    hid_desc_begin(&d, prog, iface);
+    for (uint16_t i = 0; i < len; i++) hid_desc_feed(&d, desc[i]);
+    hid_desc_end(&d);
+}
+
+
+/* boot keyboard: modifiers, reserved and 6 keys */
+static const uint8_t boot_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01,
+    0x75, 0x01, 0x95, 0x08, 0x81, 0x02,         // modifiers
+    0x75, 0x08, 0x95, 0x01, 0x81, 0x01,         // reserved
+    0x05, 0x08, 0x19, 0x01, 0x29, 0x05,
+    0x75, 0x01, 0x95, 0x05, 0x91, 0x02,         // LED output
+    0x75, 0x03, 0x95, 0x01, 0x91, 0x01,
+    0x05, 0x07, 0x19, 0x00, 0x29, 0xFF, 0x15, 0x00, 0x26, 0xFF, 0x00,
+    0x75, 0x08, 0x95, 0x06, 0x81, 0x00,         // keys array
+    0xC0,
+};
+
+/* NKRO keyboard with report ID 1 and consumer control with ID 2, report
+ * of consumer is 8 bytes as long as boot report */
+static const uint8_t nkro_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01,
+    0x75, 0x01, 0x95, 0x08, 0x81, 0x02,         // modifiers
+    0x19, 0x04, 0x29, 0x73,
+    0x75, 0x01, 0x95, 0x70, 0x81, 0x02,         // bitmap 04-73
+    0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x02,
+    0x19, 0x00, 0x2A, 0xFF, 0x03, 0x15, 0x00, 0x26, 0xFF, 0x03,
+    0x75, 0x10, 0x95, 0x03, 0x81, 0x00,         // 3 consumer usages
+    0x75, 0x08, 0x95, 0x01, 0x81, 0x01,
+    0xC0,
+};
+
+/* bitmap at top of usage range */
+static const uint8_t top_desc[] = {
+    0x05, 0x07, 0x19, 0xF9, 0x29, 0xFF,
+    0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+};
+
+/* array field beyond 2048 bits of padding */
+static const uint8_t far_desc[] = {
+    0x75, 0x08, 0x96, 0x80, 0x00, 0x81, 0x01,   // 128 bytes
+    0x75, 0x08, 0x96, 0x80, 0x00, 0x81, 0x01,   // 128 bytes
+    0x05, 0x07, 0x19, 0x00, 0x29, 0xFF, 0x15, 0x00, 0x26, 0xFF, 0x00,
+    0x75, 0x08, 0x95, 0x01, 0x81, 0x00,
+};
+
+
+static void check_boot(void)
+{
+    hid_prog_t prog;
+    uint16_t usage[HID_PROG_USAGE_WORDS];
+    hid_prog_init(&prog);
+    compile(&prog, 0, boot_desc, sizeof(boot_desc));
+    assert(prog.nslots == 1 && prog.nfields == 2);
+
+    const uint8_t keys[] = { 0x22, 0x00, 0x04, 0x05, 0x00, 0x00, 0x00, 0x00 };
+    assert(hid_prog_run(&prog, 0, keys, sizeof(keys), usage) == 0);
+    assert(usage_count(usage) == 4);
+    assert(usage_on(usage, 0xE1) && usage_on(usage, 0xE5));
+    assert(usage_on(usage, 0x04) && usage_on(usage, 0x05));
+
+    const uint8_t rollover[] = { 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 };
+    assert(hid_prog_run(&prog, 0, rollover, sizeof(rollover), usage) == HID_PROG_ROLLOVER);
+
+    // other length or interface
+    assert(hid_prog_run(&prog, 0, keys, 7, usage) == HID_PROG_UNKNOWN);
+    assert(hid_prog_run(&prog, 1, keys, sizeof(keys), usage) == HID_PROG_UNKNOWN);
+    printf("boot: ok\n");
+}
+
+static void check_nkro(void)
+{
+    hid_prog_t prog;
+    uint16_t usage[HID_PROG_USAGE_WORDS];
+    hid_prog_init(&prog);
+    compile(&prog, 0, boot_desc, sizeof(boot_desc));
+    compile(&prog, 1, nkro_desc, sizeof(nkro_desc));
+    assert(prog.nslots == 2);
+    assert(prog.id_ifaces == (1 << 1));
+
+    // ID 1: LCtrl and bitmap A(04), Z(1D), F12(45), 73
+    uint8_t nkro[16] = { 0x01, 0x01 };
+    nkro[2 + (0x04 - 0x04) / 8] |= 1 << ((0x04 - 0x04) % 8);
+    nkro[2 + (0x1D - 0x04) / 8] |= 1 << ((0x1D - 0x04) % 8);
+    nkro[2 + (0x45 - 0x04) / 8] |= 1 << ((0x45 - 0x04) % 8);
+    nkro[2 + (0x73 - 0x04) / 8] |= 1 << ((0x73 - 0x04) % 8);
+    assert(hid_prog_run(&prog, 1, nkro, sizeof(nkro), usage) == 1);
+    assert(usage_count(usage) == 5);
+    assert(usage_on(usage, 0xE0));
+    assert(usage_on(usage, 0x04) && usage_on(usage, 0x1D));
+    assert(usage_on(usage, 0x45) && usage_on(usage, 0x73));
+
+    // consumer report with ID 2 is as long as boot report, not keys
+    const uint8_t consumer[8] = { 0x02, 0xE9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    assert(hid_prog_run(&prog, 1, consumer, sizeof(consumer), usage) == HID_PROG_UNKNOWN);
+
+    // length is not used on interface with report IDs
+    const uint8_t boot[8] = { 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    assert(hid_prog_run(&prog, 1, boot, sizeof(boot), usage) == HID_PROG_UNKNOWN);
+    assert(hid_prog_run(&prog, 0, boot, sizeof(boot), usage) == 0);
+    assert(usage_count(usage) == 1 && usage_on(usage, 0x04));
+    printf("nkro: ok\n");
+}
+
+static void check_bounds(void)
+{
+    hid_prog_t prog;
+    uint16_t usage[HID_PROG_USAGE_WORDS + 1];
+
+    // bitmap F9-FF doesn't spill over usage array
+    hid_prog_init(&prog);
+    compile(&prog, 0, top_desc, sizeof(top_desc));
+    const uint8_t top[] = { 0xFF };
+    usage[HID_PROG_USAGE_WORDS] = 0xA5A5;
+    assert(hid_prog_run(&prog, 0, top, sizeof(top), usage) == 0);
+    assert(usage[HID_PROG_USAGE_WORDS] == 0xA5A5);
+    assert(usage[15] == 0xFE00 && usage_count(usage) == 7);
+
+    // field at bit 2048 is out of 255-byte report, not byte 0
+    hid_prog_init(&prog);
+    compile(&prog, 0, far_desc, sizeof(far_desc));
+    assert(prog.nfields == 1 && prog.field[0].offset == 2048);
+    uint8_t far[255];
+    memset(far, 0, sizeof(far));
+    far[0] = 0x04;
+    assert(hid_prog_run(&prog, 0, far, sizeof(far), usage) == 0);
+    assert(usage_count(usage) == 0);
+    printf("bounds: ok\n");
+}
+
+
+int main(void)
+{
+    check_boot();
+    check_nkro();
+    check_bounds();
+    return 0;
+}
@@ -0,0 +1,299 @@
+#include <string.h>
+#include "hid_prog.h"
+
+
+#define PAGE_KEYBOARD   0x07
+
+/* item prefix: tag(4) type(2) size(2) */
+#define ITEM_TYPE(p)    (((p) >> 2) & 0x03)
+#define ITEM_TAG(p)     ((p) >> 4)
+#define ITEM_LONG       0xFE
+
+enum { TYPE_MAIN, TYPE_GLOBAL, TYPE_LOCAL };
+
+enum {  // main
+    MAIN_INPUT          = 0x8,
+};
+
+enum {  // global
+    GLOBAL_USAGE_PAGE   = 0x0,
+    GLOBAL_LOGICAL_MIN  = 0x1,
+    GLOBAL_REPORT_SIZE  = 0x7,
+    GLOBAL_REPORT_ID    = 0x8,
+    GLOBAL_REPORT_COUNT = 0x9,
+};
+
+enum {  // local
+    LOCAL_USAGE         = 0x0,
+    LOCAL_USAGE_MIN     = 0x1,
+    LOCAL_USAGE_MAX     = 0x2,
+};
+
+#define INPUT_CONSTANT  0x01
+#define INPUT_VARIABLE  0x02
+
+
+void hid_prog_init(hid_prog_t *prog)
+{
+    memset(prog, 0, sizeof(hid_prog_t));
+}
+
+void hid_desc_begin(hid_desc_t *desc, hid_prog_t *prog, uint8_t iface)
+{
+    memset(desc, 0, sizeof(hid_desc_t));
+    desc->prog = prog;
+    desc->iface = iface & 0x07;
+    desc->noid_slot = 0xFF;
+}
+
+static void local_reset(hid_desc_t *d)
+{
+    d->local_page = 0;
+    d->usage_min = 0;
+    d->usage_max = 0;
+    d->has_usage = false;
+}
+
+/* input bits counter of current report ID, NULL when table is full */
+static uint16_t *input_bits(hid_desc_t *d)
+{
+    for (uint8_t i = 0; i < d->nids; i++) {
+        if (d->ids[i].id == d->report_id) return &d->ids[i].bits;
+    }
+    if (d->nids == HID_DESC_IDS) return NULL;
+    d->ids[d->nids].id = d->report_id;
+    d->ids[d->nids].bits = 0;
+    return &d->ids[d->nids++].bits;
+}
+
+static int8_t slot_of(hid_desc_t *d)
+{
+    hid_prog_t *prog = d->prog;
+
+    uint16_t iface = HID_SLOT_IFACE(d->iface);
+    if (d->report_id) {
+        uint16_t key = iface | HID_SLOT_ID | d->report_id;
+        for (uint8_t i = 0; i < prog->nslots; i++) {
+            if (prog->key[i] == key) return i;
+        }
+        if (prog->nslots == HID_PROG_SLOTS) return -1;
+        prog->key[prog->nslots] = key;
+        return prog->nslots++;
+    }
+
+    // report length is fixed at end of descriptor
+    if (d->noid_slot == 0xFF) {
+        if (prog->nslots == HID_PROG_SLOTS) return -1;
+        prog->key[prog->nslots] = iface;
+        d->noid_slot = prog->nslots++;
+    }
+    return d->noid_slot;
+}
+
+static void input(hid_desc_t *d, uint8_t flags)
+{
+    uint16_t *bits = input_bits(d);
+    if (!bits) return;
+
+    uint16_t offset = *bits;
+    *bits += (uint16_t)d->report_size * d->report_count;
+
+    uint16_t page = d->local_page ? d->local_page : d->usage_page;
+    if (page != PAGE_KEYBOARD || (flags & INPUT_CONSTANT)) return;
+    if (!d->has_usage || d->usage_min > 0xFF || d->report_count == 0) return;
+
+    hid_field_t f;
+    f.offset = offset;
+    f.size = d->report_size;
+    f.count = d->report_count;
+    f.usage_min = d->usage_min;
+    f.logical_min = 0;
+    if (flags & INPUT_VARIABLE) {
+        if (f.size != 1) return;
+        // bits beyond usage range or page are padding
+        uint16_t range = (d->usage_max > d->usage_min ? d->usage_max : d->usage_min) - d->usage_min + 1;
+        if (f.count > range) f.count = range;
+        if (f.usage_min + f.count > 0x100) f.count = 0x100 - f.usage_min;
+        f.type = HID_FIELD_BITMAP;
+    } else {
+        if (f.size > 8 || d->logical_min < 0 || d->logical_min > 0xFF) return;
+        f.logical_min = d->logical_min;
+        f.type = HID_FIELD_ARRAY;
+    }
+
+    hid_prog_t *prog = d->prog;
+    if (prog->nfields == HID_PROG_FIELDS) return;
+    int8_t slot = slot_of(d);
+    if (slot < 0) return;
+    f.slot = slot;
+    prog->field[prog->nfields++] = f;
+}
+
+static void item(hid_desc_t *d)
+{
+    uint8_t prefix = d->prefix;
+    uint8_t size = d->need;
+    uint32_t data = d->data;
+
+    switch (ITEM_TYPE(prefix)) {
+    case TYPE_MAIN:
+        if (ITEM_TAG(prefix) == MAIN_INPUT) {
+            input(d, data);
+        }
+        // Output, Feature and Collections
+        local_reset(d);
+        break;
+    case TYPE_GLOBAL:
+        switch (ITEM_TAG(prefix)) {
+        case GLOBAL_USAGE_PAGE:
+            d->usage_page = data;
+            break;
+        case GLOBAL_LOGICAL_MIN:
+            // signed
+            if (size == 1)      d->logical_min = (int8_t)data;
+            else if (size == 2) d->logical_min = (int16_t)data;
+            else                d->logical_min = (int32_t)data;
+            break;
+        case GLOBAL_REPORT_SIZE:
+            d->report_size = (data > 0xFF ? 0xFF : data);
+            break;
+        case GLOBAL_REPORT_ID:
+            d->report_id = data;
+            // all reports of the interface have ID, even those without keyboard fields
+            d->prog->id_ifaces |= (1 << d->iface);
+            break;
+        case GLOBAL_REPORT_COUNT:
+            d->report_count = (data > 0xFF ? 0xFF : data);
+            break;
+        }
+        break;
+    case TYPE_LOCAL:
+        // only first range or run of consecutive usages is used
+        switch (ITEM_TAG(prefix)) {
+        case LOCAL_USAGE:
+            if (d->has_usage) {
+                if ((uint16_t)data == d->usage_max + 1) d->usage_max++;
+                break;
+            }
+            d->usage_min = d->usage_max = data;
+            d->has_usage = true;
+            break;
+        case LOCAL_USAGE_MIN:
+            d->usage_min = data;
+            d->has_usage = true;
+            break;
+        case LOCAL_USAGE_MAX:
+            d->usage_max = data;
+            break;
+        default:
+            return;
+        }
+        // extended usage with page in upper 16 bits
+        if (size == 4) d->local_page = data >> 16;
+        break;
+    }
+}
+
+void hid_desc_feed(hid_desc_t *desc, uint8_t data)
+{
+    hid_desc_t *d = desc;
+
+    if (d->got == 0) {
+        // prefix
+        d->prefix = data;
+        d->data = 0;
+        d->need = (data & 0x03) == 3 ? 4 : (data & 0x03);
+        d->got = 1;
+    } else if (d->prefix == ITEM_LONG) {
+        // long item: size, tag and data are skipped
+        if (d->got == 1) d->need = data + 1;
+        d->got++;
+    } else {
+        d->data |= (uint32_t)data << ((d->got - 1) * 8);
+        d->got++;
+    }
+
+    if (d->got > d->need) {
+        if (d->prefix != ITEM_LONG) item(d);
+        d->got = 0;
+    }
+}
+
+void hid_desc_end(hid_desc_t *desc)
+{
+    if (desc->noid_slot == 0xFF) return;
+
+    // report without ID is told with its length
+    for (uint8_t i = 0; i < desc->nids; i++) {
+        if (desc->ids[i].id == 0) {
+            uint16_t len = (desc->ids[i].bits + 7) / 8;
+            desc->prog->key[desc->noid_slot] |= (len > 0xFF ? 0xFF : len);
+            return;
+        }
+    }
+}
+
+
+/* up to 8 bits at bit offset, bits out of report read as zero */
+static inline uint8_t get_bits(const uint8_t *data, uint8_t len, uint16_t offset, uint8_t n)
+{
+    uint16_t i = offset >> 3;
+    uint16_t w = 0;
+    if (i < len)     w  = data[i];
+    if (i + 1 < len) w |= (uint16_t)data[i + 1] << 8;
+    return (w >> (offset & 7)) & ((1 << n) - 1);
+}
+
+int8_t hid_prog_run(const hid_prog_t *prog, uint8_t iface, const uint8_t *report, uint8_t len,
+                    uint16_t usage[HID_PROG_USAGE_WORDS])
+{
+    int8_t slot = HID_PROG_UNKNOWN;
+    iface &= 0x07;
+    for (uint8_t i = 0; i < prog->nslots; i++) {
+        uint16_t key = prog->key[i];
+        if ((key & HID_SLOT_IFACE_MASK) != HID_SLOT_IFACE(iface)) continue;
+        if (key & HID_SLOT_ID) {
+            if (len && report[0] == (uint8_t)key) { slot = i; break; }
+        } else if (!(prog->id_ifaces & (1 << iface))) {
+            // length tells report only on interface without report IDs
+            if (len == (uint8_t)key) { slot = i; break; }
+        }
+    }
+    if (slot < 0) return slot;
+    if (prog->key[slot] & HID_SLOT_ID) {
+        report++;
+        len--;
+    }
+
+    memset(usage, 0, HID_PROG_USAGE_WORDS * sizeof(uint16_t));
+    for (uint8_t i = 0; i < prog->nfields; i++) {
+        const hid_field_t *f = &prog->field[i];
+        if (f->slot != slot) continue;
+
+        if (f->type == HID_FIELD_BITMAP) {
+            // 8 bits at a time shifted into place of usage bitmap
+            for (uint16_t j = 0; j < f->count; j += 8) {
+                uint8_t n = (f->count - j < 8 ? f->count - j : 8);
+                uint8_t v = get_bits(report, len, f->offset + j, n);
+                if (!v) continue;
+                uint8_t u = f->usage_min + j;
+                uint8_t sh = u & 0x0F;
+                usage[u >> 4] |= (uint16_t)v << sh;
+                // no word after usage FF
+                if (sh > 8 && (u >> 4) < 15) usage[(u >> 4) + 1] |= v >> (16 - sh);
+            }
+        } else {
+            for (uint8_t j = 0; j < f->count; j++) {
+                uint8_t v = get_bits(report, len, f->offset + (uint16_t)j * f->size, f->size);
+                if (v < f->logical_min) continue;
+                uint16_t u = f->usage_min + (v - f->logical_min);
+                if (u == 0x01) return HID_PROG_ROLLOVER;
+                if (u > 0xFF) continue;
+                usage[u >> 4] |= (uint16_t)1 << (u & 0x0F);
+            }
+        }
+    }
+    // 00-03 are no event and error codes
+    usage[0] &= ~0x000F;
+    return slot;
+}
@@ -0,0 +1,114 @@
+/*
+ * HID keyboard report decoder compiled from report descriptor
+ *
+ * Report descriptor is parsed once at enumeration and input fields of
+ * Keyboard/Keypad page are compiled into a short list of bit offsets and
+ * sizes. Input report is decoded into 256-bit usage bitmap with shifts and
+ * masks along the list, without interpreting descriptor items on each report.
+ *
+ * Reports are told apart with interface and report ID, or with interface and
+ * report length when the interface doesn't use report IDs. Each report
+ * kind(slot) has its own key state so that boot and NKRO interfaces of a
+ * keyboard can be merged.
+ */
+#ifndef HID_PROG_H
+#define HID_PROG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifndef HID_PROG_FIELDS
+#   define HID_PROG_FIELDS  6
+#endif
+#ifndef HID_PROG_SLOTS
+#   define HID_PROG_SLOTS   2
+#endif
+#define HID_PROG_USAGE_WORDS    16
+
+/* return of hid_prog_run() other than slot */
+#define HID_PROG_UNKNOWN    -1      // report without keyboard fields
+#define HID_PROG_ROLLOVER   -2      // ErrorRollOver in array
+
+enum {
+    HID_FIELD_BITMAP,   // variable, one bit per usage
+    HID_FIELD_ARRAY,    // array of usage indexes
+};
+
+typedef struct {
+    uint8_t  slot;
+    uint8_t  type;
+    uint16_t offset;        // bit offset after report ID
+    uint8_t  size;          // bits of element
+    uint8_t  count;         // number of elements
+    uint8_t  usage_min;
+    uint8_t  logical_min;
+} hid_field_t;
+
+/* slot key: interface, and report ID or report length in low byte */
+#define HID_SLOT_ID             0x100   // low byte is report ID, otherwise report length
+#define HID_SLOT_IFACE(i)       ((uint16_t)(i) << 12)
+#define HID_SLOT_IFACE_MASK     0x7000
+
+typedef struct {
+    uint16_t key[HID_PROG_SLOTS];
+    uint8_t  nslots;
+    uint8_t  nfields;
+    uint8_t  id_ifaces;     // bit of interface which uses report IDs
+    hid_field_t field[HID_PROG_FIELDS];
+} hid_prog_t;
+
+
+/* Descriptor compiler, fed byte by byte as descriptor is received */
+#define HID_DESC_IDS    4
+
+typedef struct {
+    hid_prog_t *prog;
+    uint8_t  iface;         // interface number 0-7
+
+    // item being received
+    uint8_t  prefix;
+    uint8_t  need;
+    uint8_t  got;
+    uint32_t data;
+
+    // global items
+    uint16_t usage_page;
+    int32_t  logical_min;
+    uint8_t  report_size;
+    uint8_t  report_count;
+    uint8_t  report_id;
+
+    // local items
+    uint16_t local_page;    // page of extended usage, 0 if not given
+    uint16_t usage_min;
+    uint16_t usage_max;
+    bool     has_usage;
+
+    // input bits so far of each report ID
+    struct {
+        uint8_t  id;
+        uint16_t bits;
+    } ids[HID_DESC_IDS];
+    uint8_t  nids;
+    uint8_t  noid_slot;     // slot of report without ID waiting for its length, or 0xFF
+} hid_desc_t;
+
+void hid_prog_init(hid_prog_t *prog);
+void hid_desc_begin(hid_desc_t *desc, hid_prog_t *prog, uint8_t iface);
+void hid_desc_feed(hid_desc_t *desc, uint8_t data);
+void hid_desc_end(hid_desc_t *desc);
+
+/* Decodes report from interface into usage bitmap, returns its slot or HID_PROG_UNKNOWN/ROLLOVER */
+int8_t hid_prog_run(const hid_prog_t *prog, uint8_t iface, const uint8_t *report, uint8_t len,
+                    uint16_t usage[HID_PROG_USAGE_WORDS]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
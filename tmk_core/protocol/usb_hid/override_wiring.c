@@ -5,6 +5,7 @@
 #include <util/delay.h>
 #include "common/timer.h"
 #include "Arduino.h"
+#include "usb_hid.h"
 
 
 unsigned long millis()
@@ -15,9 +16,18 @@ unsigned long micros()
 {
     return timer_read32() * 1000UL;
 }
+__attribute__((weak))
+void hook_usb_host_delay(void) {}
+
+/* wait at least ms, the library can be made to do other work while waiting
+ * Timer has 1ms resolution, this waits until ms+1 ticks have passed, delay(0)
+ * waits up to 1ms for next tick instead of returning at once. */
 void delay(unsigned long ms)
 {
-    _delay_ms(ms);
+    uint32_t start = timer_read32();
+    while (timer_elapsed32(start) <= ms) {
+        hook_usb_host_delay();
+    }
 }
 void delayMicroseconds(unsigned int us)
 {
@@ -2,26 +2,167 @@
 #include "usb_hid.h"
 
 #include "print.h"
+#include "debug.h"
+#include "spsc_queue.h"
+
+
+/*
+ * Input reports are recorded in binary while debug_keyboard is on and
+ * printed later with parser_trace_print() out of USB::Task().
+ */
+#define TRACE_ROLLOVER  0x80    // flag in len: report ignored as rollover error
+
+// modifiers, reserved and 6 keys
+#define BOOT_REPORT_SIZE    8
+
+typedef struct {
+    uint16_t time;
+    uint8_t addr;
+    uint8_t len;
+    uint8_t data[BOOT_REPORT_SIZE];
+} parser_trace_t;
+
+SPSC_QUEUE(trace, parser_trace_t, 8)
 
 
 void KBDReportParser::Parse(USBHID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf)
 {
-    xprintf("input %d:", hid->GetAddress());
-    for (uint8_t i = 0; i < len; i++) {
-        xprintf(" %02X", buf[i]);
-    }
-    xprintf("\r\n");
-
+    bool rollover;
+#ifdef USB_HID_REPORT_ENABLE
+    // report protocol: decoded with program compiled at enumeration
+    uint16_t decoded[KBD_USAGE_WORDS];
+    int8_t slot = hid_prog_run(&prog, iface, buf, len, decoded);
+    rollover = (slot == HID_PROG_ROLLOVER);
+#else
     // Rollover error
     // Cherry: 0101010101010101
     // https://geekhack.org/index.php?topic=69169.msg2638223#msg2638223
     // Apple:  0000010101010101
     // https://geekhack.org/index.php?topic=69169.msg2760969#msg2760969
-    if (buf[2] == 0x01) {
-       xprintf("Rollover error: ignored\r\n");
-       return;
+    rollover = (buf[2] == 0x01);
+#endif
+
+    if (debug_keyboard) {
+        parser_trace_t t;
+        t.time = millis();
+        t.addr = hid->GetAddress();
+        t.len = (len & ~TRACE_ROLLOVER) | (rollover ? TRACE_ROLLOVER : 0);
+        ::memcpy(t.data, buf, len < sizeof(t.data) ? len : sizeof(t.data));
+        trace_put(t);
+    }
+
+    if (rollover) return;
+
+#ifdef USB_HID_REPORT_ENABLE
+    // reports of other kinds like consumer control, or from mouse, are ignored
+    if (slot < 0) return;
+    ::memcpy(slot_usage[slot], decoded, sizeof(decoded));
+    for (uint8_t i = 0; i < KBD_USAGE_WORDS; i++) {
+        uint16_t u = 0;
+        for (uint8_t s = 0; s < prog.nslots; s++) {
+            u |= slot_usage[s][i];
+        }
+        usage[i] = u;
+    }
+#else
+    // boot report: modifiers, reserved and keys
+    ::memset(usage, 0, sizeof(usage));
+    usage[0x0E] = buf[0];
+    for (uint8_t i = 2; i < len && i < BOOT_REPORT_SIZE; i++) {
+        // 00-03 are no event and error codes
+        if (buf[i] > 0x03) {
+            usage[buf[i] >> 4] |= (uint16_t)1 << (buf[i] & 0x0F);
+        }
+    }
+#endif
+    changed = true;
+}
+
+#ifdef USB_HID_REPORT_ENABLE
+void KBDReportDescParser::Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        hid_desc_feed(&desc, pbuf[i]);
+    }
+}
+
+uint8_t HIDReportKeyboard::OnInitSuccessful()
+{
+    KBDReportParser *parser = (KBDReportParser *)GetReportParser(0);
+    if (!parser) return 0;
+
+    // descriptor of each interface is compiled into one program
+    KBDReportDescParser desc;
+    hid_prog_init(&parser->prog);
+    ::memset(parser->slot_usage, 0, sizeof(parser->slot_usage));
+    for (uint8_t i = 0; i < bNumIface; i++) {
+        hid_desc_begin(&desc.desc, &parser->prog, hidInterfaces[i].bmInterface);
+        uint8_t rcode = GetReportDescr(hidInterfaces[i].bmInterface, &desc);
+        if (rcode) {
+            xprintf("report descriptor %d: error %02X\r\n", hidInterfaces[i].bmInterface, rcode);
+            continue;
+        }
+        hid_desc_end(&desc.desc);
+    }
+
+    if (debug_keyboard) {
+        for (uint8_t i = 0; i < parser->prog.nfields; i++) {
+            hid_field_t *f = &parser->prog.field[i];
+            xprintf("field: key:%04X %s off:%d size:%d count:%d usage:%02X\r\n",
+                    parser->prog.key[f->slot], f->type == HID_FIELD_BITMAP ? "bitmap" : "array",
+                    f->offset, f->size, f->count, f->usage_min);
+        }
+    }
+    return 0;
+}
+
+// largest full speed interrupt packet
+#define REPORT_BUF_SIZE     64
+
+/* HIDUniversal::Poll() doesn't tell interface of report, keyboard interfaces
+ * are polled every 1ms here instead. Endpoint NAKs until its interval. */
+uint8_t HIDReportKeyboard::Poll()
+{
+    KBDReportParser *parser = (KBDReportParser *)GetReportParser(0);
+    if (!isReady() || !parser) return 0;
+    if ((int32_t)(millis() - next_poll) < 0) return 0;
+    next_poll = millis() + 1;
+
+    uint8_t buf[REPORT_BUF_SIZE];
+    for (uint8_t i = 0; i < bNumIface; i++) {
+        uint8_t index = hidInterfaces[i].epIndex[epInterruptInIndex];
+        if (!index) continue;
+        uint16_t read = epInfo[index].maxPktSize;
+        if (read > sizeof(buf)) read = sizeof(buf);
+        uint8_t rcode = pUsb->inTransfer(bAddress, epInfo[index].epAddr, &read, buf);
+        if (rcode || read == 0) continue;   // hrNAK: no new report
+        parser->iface = hidInterfaces[i].bmInterface;
+        parser->Parse(this, false, read, buf);
     }
+    return 0;
+}
+#endif
+
+void parser_trace_print(void)
+{
+    static uint8_t lost = 0;
 
-    ::memcpy(&report, buf, sizeof(report_keyboard_t));
-    time_stamp = millis();
+    while (!trace_empty()) {
+        parser_trace_t t = trace_get();
+        uint8_t len = t.len & ~TRACE_ROLLOVER;
+
+        xprintf("%04X input %d:", t.time, t.addr);
+        for (uint8_t i = 0; i < len && i < sizeof(t.data); i++) {
+            xprintf(" %02X", t.data[i]);
+        }
+        xprintf("\r\n");
+        if (t.len & TRACE_ROLLOVER) {
+            xprintf("Rollover error: ignored\r\n");
+        }
+    }
+
+    if (trace_overflow() != lost) {
+        lost = trace_overflow();
+        xprintf("input trace lost: %d\r\n", lost);
+    }
 }
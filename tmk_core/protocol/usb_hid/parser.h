@@ -3,13 +3,53 @@
 
 #include "usbhid.h"
 #include "report.h"
+#ifdef USB_HID_REPORT_ENABLE
+#include "hiduniversal.h"
+#include "hid_prog.h"
+#endif
+
+/* Key state is kept as 256-bit bitmap of usage, usage code is bit (code & 0x0F)
+ * of usage[code >> 4]. Modifiers are E0-E7 in usage[0x0E]. */
+#define KBD_USAGE_WORDS 16
 
 class KBDReportParser : public HIDReportParser
 {
 public:
-    report_keyboard_t report;
-    uint16_t time_stamp;
+    uint16_t usage[KBD_USAGE_WORDS];
+    bool changed;   // set on new report, cleared by user
+#ifdef USB_HID_REPORT_ENABLE
+    // report protocol: decoder compiled from report descriptor and key state of each slot
+    hid_prog_t prog;
+    uint16_t slot_usage[HID_PROG_SLOTS][KBD_USAGE_WORDS];
+    uint8_t iface;      // interface of report given to Parse()
+#endif
     virtual void Parse(USBHID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf);
 };
 
+#ifdef USB_HID_REPORT_ENABLE
+/* Keyboard in report protocol. Report descriptors of its interfaces are
+ * compiled into prog of KBDReportParser set with SetReportParser(0, ...), and
+ * its interfaces are polled here to tell the parser which one a report is from. */
+class KBDReportDescParser : public USBReadParser
+{
+public:
+    hid_desc_t desc;
+    virtual void Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset);
+};
+
+class HIDReportKeyboard : public HIDUniversal
+{
+public:
+    HIDReportKeyboard(USB *p) : HIDUniversal(p), next_poll(0) {}
+    virtual uint8_t Poll();
+protected:
+    virtual uint8_t OnInitSuccessful();
+private:
+    uint32_t next_poll;
+};
+#endif
+
+/* print input reports traced while debug_keyboard is on, call it out of USB::Task() */
+void parser_trace_print(void);
+
 #endif
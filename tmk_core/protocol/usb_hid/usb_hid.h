@@ -7,4 +7,18 @@
 extern report_keyboard_t usb_hid_keyboard_report;
 extern uint16_t usb_hid_time_stamp;
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called repeatedly while USB Host Shield library waits in delay() */
+/* This runs inside USB::Task(), typically in matrix_scan() of keyboard_task(),
+ * don't call keyboard_task() or start USB transfers other than polling. */
+/* Default behaviour: do nothing. */
+void hook_usb_host_delay(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -41,18 +41,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <util/delay.h>
 #include "xt.h"
 #include "wait.h"
-#include "print.h"
-#include "ringbuf.h"
+#include "spsc_queue.h"
 
 
-#define BUF_SIZE 16
-static uint8_t buf[BUF_SIZE];
-static ringbuf_t rb = {
-    .buffer = buf,
-    .head = 0,
-    .tail = 0,
-    .size_mask = BUF_SIZE - 1
-};
+SPSC_QUEUE(rb, uint8_t, 16)
 
 void xt_host_init(void)
 {
@@ -79,10 +71,10 @@ void xt_host_init(void)
 /* get data received by interrupt */
 uint8_t xt_host_recv(void)
 {
-    if (ringbuf_is_empty(&rb)) {
+    if (rb_empty()) {
         return 0;
     } else {
-        int16_t d = ringbuf_get(&rb);
+        uint8_t d = rb_get();
         XT_DATA_IN();  // ready to receive from keyboard
         return d;
     }
@@ -123,10 +115,9 @@ ISR(XT_INT_VECT)
             break;
     }
     if (state++ == BIT7) {
-        ringbuf_put(&rb, data);
-        if (ringbuf_is_full(&rb)) {
+        rb_put(data);
+        if (rb_full()) {
             XT_DATA_LO();  // inhibit keyboard sending
-            print("Full");
         }
         state = START;
         data = 0;
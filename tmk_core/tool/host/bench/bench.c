@@ -0,0 +1,341 @@
+/*
+ * Scan-to-report latency benchmark
+ *
+ * Replays scripted matrix changes through keyboard_task() with virtual timer
+ * and counts loop iterations until a report reaches host driver, also CPU
+ * cycles spent in keyboard_task() on the iteration where each change is
+ * seen. Iteration counts are deterministic and can be compared between
+ * revisions, cycle counts depend on host machine.
+ *
+ * Exits with number of failed scenarios: a step expected to send report got
+ * none(MISSED), report came later than limit of scenario(LATE) or key is left
+ * in the last report(STUCK).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "keyboard.h"
+#include "host.h"
+#include "timer.h"
+#include "action.h"
+#include "action_layer.h"
+#include "action_util.h"
+#include "action_tapping.h"
+#include "record.h"
+#include "debounce.h"
+#include "bench.h"
+
+
+#define COUNTOF(a)  (sizeof(a) / sizeof((a)[0]))
+
+
+/*
+ * Scenarios
+ *   row 0-1: plain keys, row 2: LSFT LCTL LALT LT(1,SPC) MT(LCTL,ESC) MO(2) MT(LSFT,BSPC) LT(2,TAB)
+ *   RSFT ENT MACRO(0)
+ */
+static const bench_step_t type_steps[] = {
+    BENCH_PRESS(0, 0, 0),     BENCH_RELEASE(30, 0, 0),
+    BENCH_PRESS(60, 0, 1),    BENCH_RELEASE(90, 0, 1),
+    BENCH_PRESS(120, 1, 2),   BENCH_RELEASE(150, 1, 2),
+    BENCH_PRESS(180, 1, 3),   BENCH_RELEASE(210, 1, 3),
+};
+
+static const bench_step_t roll_steps[] = {
+    BENCH_PRESS(0, 0, 0),
+    BENCH_PRESS(5, 0, 1),
+    BENCH_PRESS(10, 0, 2),
+    BENCH_RELEASE(12, 0, 0),
+    BENCH_PRESS(15, 0, 3),
+    BENCH_RELEASE(17, 0, 1),
+    BENCH_RELEASE(20, 0, 2),
+    BENCH_RELEASE(25, 0, 3),
+};
+
+static const bench_step_t mods_steps[] = {
+    BENCH_PRESS(0, 2, 0),
+    BENCH_PRESS(20, 0, 0),    BENCH_RELEASE(40, 0, 0),
+    BENCH_RELEASE(60, 2, 0),
+};
+
+static const bench_step_t tap_steps[] = {
+    BENCH_PRESS(0, 2, 3),     BENCH_RELEASE(50, 2, 3),
+    BENCH_PRESS(300, 2, 4),   BENCH_RELEASE(350, 2, 4),
+};
+
+static const bench_step_t hold_steps[] = {
+    BENCH_PRESS(0, 2, 4),
+    BENCH_PRESS(300, 0, 0),   BENCH_RELEASE(330, 0, 0),
+    BENCH_RELEASE(400, 2, 4),
+};
+
+static const bench_step_t layer_steps[] = {
+    BENCH_PRESS_N(0, 2, 3),
+    BENCH_PRESS(50, 0, 0),    BENCH_RELEASE(80, 0, 0),
+    BENCH_RELEASE_N(100, 2, 3),
+    BENCH_PRESS_N(400, 2, 5),
+    BENCH_PRESS(420, 0, 0),   BENCH_RELEASE(440, 0, 0),
+    BENCH_RELEASE_N(460, 2, 5),
+};
+
+/* typing on layer 0 under transparent layer 3-7 */
+static const bench_step_t deep_steps[] = {
+    BENCH_PRESS(0, 0, 0),     BENCH_RELEASE(10, 0, 0),
+    BENCH_PRESS(20, 0, 1),    BENCH_RELEASE(30, 0, 1),
+    BENCH_PRESS(40, 0, 0),    BENCH_RELEASE(50, 0, 0),
+    BENCH_PRESS(60, 0, 1),    BENCH_RELEASE(70, 0, 1),
+    BENCH_PRESS(80, 1, 2),    BENCH_RELEASE(90, 1, 2),
+};
+
+/* dense roll under dual-role keys, more events than waiting buffer within TAPPING_TERM */
+static const bench_step_t stress_steps[] = {
+    BENCH_PRESS_N(0, 2, 3),
+    BENCH_PRESS(4, 0, 0),     BENCH_PRESS(8, 0, 1),     BENCH_RELEASE(10, 0, 0),
+    BENCH_PRESS(12, 0, 2),    BENCH_RELEASE(14, 0, 1),  BENCH_PRESS(16, 0, 3),
+    BENCH_RELEASE(18, 0, 2),  BENCH_PRESS(20, 0, 4),    BENCH_RELEASE(22, 0, 3),
+    BENCH_PRESS(24, 0, 5),    BENCH_RELEASE(26, 0, 4),  BENCH_PRESS(28, 0, 6),
+    BENCH_RELEASE(30, 0, 5),  BENCH_RELEASE(32, 0, 6),
+    BENCH_RELEASE_N(40, 2, 3),
+    BENCH_PRESS_N(300, 2, 4), BENCH_PRESS_N(302, 2, 6),
+    BENCH_PRESS(306, 1, 0),   BENCH_PRESS(308, 1, 1),   BENCH_RELEASE(310, 1, 0),
+    BENCH_PRESS(312, 1, 2),   BENCH_RELEASE(314, 1, 1), BENCH_PRESS(316, 1, 3),
+    BENCH_RELEASE(318, 1, 2), BENCH_PRESS(320, 1, 4),   BENCH_RELEASE(322, 1, 3),
+    BENCH_RELEASE(324, 1, 4),
+    BENCH_RELEASE(330, 2, 6), BENCH_RELEASE(332, 2, 4),
+};
+
+/* key typed during tapping, result depends on TAPPING_POLICY */
+static const bench_step_t interrupt_steps[] = {
+    BENCH_PRESS_N(0, 2, 7),
+    BENCH_PRESS(20, 0, 0),    BENCH_RELEASE(40, 0, 0),
+    BENCH_RELEASE_N(60, 2, 7),
+};
+
+/* tap key held over TAPPING_TERM alone, sends tap with TAPPING_RETRO_TAP */
+static const bench_step_t retro_steps[] = {
+    BENCH_PRESS_N(0, 2, 4),   BENCH_RELEASE(300, 2, 4),
+};
+
+/* key typed while macro with WAIT is playing */
+static const bench_step_t macro_steps[] = {
+    BENCH_PRESS(0, 2, 10),    BENCH_RELEASE_N(10, 2, 10),
+#ifdef ACTION_MACRO_ASYNC
+    BENCH_PRESS(20, 0, 1),    BENCH_RELEASE(30, 0, 1),
+#else
+    /* blocking macro: press and release come in one scan after it and cancel out */
+    BENCH_PRESS_N(20, 0, 1),  BENCH_RELEASE_N(30, 0, 1),
+#endif
+};
+
+#if DEBOUNCE_ALGO == DEBOUNCE_KEY_DEFER
+/* lone changes are sampled from the scan they are seen and reported on the fourth sample */
+#define BOUNCE_PERIOD   ((DEBOUNCE + 2) / 3 ? (DEBOUNCE + 2) / 3 : 1)
+#define BOUNCE_GAP      (BOUNCE_PERIOD * 8)
+static const bench_step_t bounce_steps[] = {
+    BENCH_PRESS(0, 0, 0),                 BENCH_RELEASE(BOUNCE_GAP, 0, 0),
+    BENCH_PRESS(BOUNCE_GAP * 2 + 1, 0, 1), BENCH_RELEASE(BOUNCE_GAP * 3 + 2, 0, 1),
+};
+#endif
+
+#define SCENARIO(name)  { #name, name##_steps, COUNTOF(name##_steps), 0, 0 }
+#define SCENARIO_LAYERS(name, layers)  { #name, name##_steps, COUNTOF(name##_steps), (layers), 0 }
+#define SCENARIO_MAX_MS(name, ms)  { #name, name##_steps, COUNTOF(name##_steps), 0, (ms) }
+static const bench_scenario_t scenarios[] = {
+    SCENARIO(type),
+    SCENARIO(roll),
+    SCENARIO(mods),
+    SCENARIO(tap),
+    SCENARIO(hold),
+    SCENARIO(layer),
+    SCENARIO_LAYERS(deep, 0xF8),
+    SCENARIO(stress),
+    SCENARIO(interrupt),
+    SCENARIO(retro),
+    SCENARIO(macro),
+#if DEBOUNCE_ALGO == DEBOUNCE_KEY_DEFER
+    SCENARIO_MAX_MS(bounce, BOUNCE_PERIOD * 3),
+#endif
+};
+
+
+/*
+ * Measurement
+ */
+typedef struct {
+    uint32_t iter;      /* loop iteration where change is seen by matrix_scan() */
+    int32_t  latency;   /* iterations until report, -1 when no report */
+    uint32_t ms;        /* virtual ms from scripted time of step until report */
+    uint64_t cycles;    /* cycles of keyboard_task() on that iteration */
+} bench_result_t;
+
+static bench_result_t results[64];
+
+static inline uint64_t bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void bench_settle(void)
+{
+    for (uint16_t i = 0; i < BENCH_SETTLE_LOOPS; i++) {
+        timer_count += BENCH_TICK_MS;
+        keyboard_task();
+    }
+}
+
+static void bench_reset(void)
+{
+    bench_matrix_clear();
+    bench_settle();
+    clear_keyboard();
+    layer_clear();
+    host_record_clear();
+}
+
+/* returns false when scenario fails */
+static bool bench_run(const bench_scenario_t *s)
+{
+    uint8_t next = 0;
+    uint8_t pending = 0;        /* first step not yet reported */
+    uint16_t reports = host_record_count();
+    uint64_t idle_cycles = 0;
+    uint32_t idle_loops = 0;
+    uint32_t start = timer_read32() + BENCH_TICK_MS;    /* first loop is at time 0 */
+    uint32_t end = s->steps[s->len - 1].time + BENCH_SETTLE_LOOPS * BENCH_TICK_MS;
+
+    if (s->len > COUNTOF(results)) {
+        printf("%s: too many steps\n", s->name);
+        return false;
+    }
+    memset(results, 0, sizeof(results));
+    if (s->layers) layer_or(s->layers);
+
+    for (uint32_t iter = 0; next < s->len || timer_read32() - start < end; iter++) {
+        timer_count += BENCH_TICK_MS;
+        uint32_t now = timer_read32() - start;
+
+        uint8_t first = next;
+        while (next < s->len && s->steps[next].time <= now) {
+            bench_matrix_set(s->steps[next].row, s->steps[next].col, s->steps[next].pressed);
+            results[next].iter = iter;
+            results[next].latency = -1;
+            next++;
+        }
+
+        uint64_t c = bench_cycles();
+        keyboard_task();
+        c = bench_cycles() - c;
+
+        if (first != next) {
+            for (uint8_t i = first; i < next; i++) results[i].cycles = c;
+        } else {
+            idle_cycles += c;
+            idle_loops++;
+        }
+
+        if (host_record_count() != reports) {
+            reports = host_record_count();
+            for (; pending < next; pending++) {
+                if (s->steps[pending].report) {
+                    results[pending].latency = iter - results[pending].iter;
+                    results[pending].ms = timer_read32() - start - s->steps[pending].time;
+                }
+            }
+        }
+    }
+
+    printf("%s:\n", s->name);
+    printf("  %5s %6s %4s %3s %6s %6s %10s\n", "step", "time", "key", "dir", "iters", "ms", "cycles");
+    int32_t worst = 0;
+    uint32_t worst_ms = 0;
+    bool late = false;
+    uint8_t missed = 0;
+    for (uint8_t i = 0; i < s->len; i++) {
+        const bench_step_t *st = &s->steps[i];
+        printf("  %5u %6u %02X%02X %3c ", i, st->time, st->row, st->col, st->pressed ? 'd' : 'u');
+        if (!st->report) {
+            printf("%6s %6s ", "", "");
+        } else if (results[i].latency < 0) {
+            printf("%6s %6s ", "-", "-");
+            missed++;
+        } else {
+            printf("%6d %6u ", results[i].latency, results[i].ms);
+            if (results[i].latency > worst) worst = results[i].latency;
+            if (results[i].ms > worst_ms) worst_ms = results[i].ms;
+            if (s->max_ms && results[i].ms > s->max_ms) late = true;
+        }
+        printf("%10llu\n", (unsigned long long)results[i].cycles);
+    }
+    printf("  reports: %u  worst: %d iters %u ms  idle: %llu cycles/loop\n",
+            host_record_count(), worst, worst_ms,
+            (unsigned long long)(idle_loops ? idle_cycles / idle_loops : 0));
+    if (missed) {
+        printf("  MISSED: %u steps without report\n", missed);
+    }
+    if (late) {
+        printf("  LATE: worst %u ms over %u ms\n", worst_ms, s->max_ms);
+    }
+
+#ifdef BENCH_DUMP
+    for (uint16_t i = 0; i < host_record_count(); i++) {
+        host_record_t *r = host_record_get(i);
+        if (!r) continue;
+        printf("  %6u:", r->time);
+        for (uint8_t j = 0; j < KEYBOARD_REPORT_SIZE; j++) printf(" %02X", r->keyboard.raw[j]);
+        printf("\n");
+    }
+#endif
+
+    /* all keys are released at end of scenario, so should be last report */
+    bool stuck = false;
+    host_record_t *last = host_record_get(host_record_count() - 1);
+    if (last) {
+        for (uint8_t i = 0; i < KEYBOARD_REPORT_SIZE; i++) {
+            if (last->keyboard.raw[i]) stuck = true;
+        }
+        if (stuck) {
+            printf("  STUCK:");
+            for (uint8_t i = 0; i < KEYBOARD_REPORT_SIZE; i++) printf(" %02X", last->keyboard.raw[i]);
+            printf("\n");
+        }
+    }
+    printf("\n");
+    return !missed && !late && !stuck;
+}
+
+
+int main(int argc, char **argv)
+{
+    keyboard_setup();
+    keyboard_init();
+    host_set_driver(&host_record_driver);
+
+    printf("tmk_core host bench: MATRIX %ux%u, tick %ums, TAPPING_TERM %ums\n\n",
+            MATRIX_ROWS, MATRIX_COLS, BENCH_TICK_MS, TAPPING_TERM);
+
+    int failed = 0;
+    for (uint8_t i = 0; i < COUNTOF(scenarios); i++) {
+        if (argc > 1) {
+            bool match = false;
+            for (int a = 1; a < argc; a++) {
+                if (strcmp(argv[a], scenarios[i].name) == 0) match = true;
+            }
+            if (!match) continue;
+        }
+        bench_reset();
+        if (!bench_run(&scenarios[i])) {
+            printf("FAIL: %s\n\n", scenarios[i].name);
+            failed++;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,36 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Scenario step: change of a key at virtual time(ms from scenario start) */
+typedef struct {
+    uint16_t time;
+    uint8_t  row;
+    uint8_t  col;
+    bool     pressed;
+    bool     report;    /* change is expected to result in keyboard report */
+} bench_step_t;
+
+#define BENCH_PRESS(t, r, c)    { .time = (t), .row = (r), .col = (c), .pressed = true,  .report = true  }
+#define BENCH_RELEASE(t, r, c)  { .time = (t), .row = (r), .col = (c), .pressed = false, .report = true  }
+/* change which doesn't send report by itself like layer switch */
+#define BENCH_PRESS_N(t, r, c)  { .time = (t), .row = (r), .col = (c), .pressed = true,  .report = false }
+#define BENCH_RELEASE_N(t, r, c) { .time = (t), .row = (r), .col = (c), .pressed = false, .report = false }
+
+typedef struct {
+    const char *name;
+    const bench_step_t *steps;
+    uint8_t len;
+    uint32_t layers;    /* layer_state set before first step */
+    uint32_t max_ms;    /* steps reported later than this are LATE, 0 for no limit */
+} bench_scenario_t;
+
+
+/* scripted matrix */
+void bench_matrix_set(uint8_t row, uint8_t col, bool on);
+void bench_matrix_clear(void);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+
+/* key matrix size */
+#ifndef MATRIX_ROWS
+#define MATRIX_ROWS 8
+#endif
+#ifndef MATRIX_COLS
+#define MATRIX_COLS 16
+#endif
+
+/* debounce time(ms) and algorithm, see common/debounce.h */
+#ifndef DEBOUNCE
+#define DEBOUNCE    0
+#endif
+//#define DEBOUNCE_ALGO   DEBOUNCE_KEY_EAGER
+
+/* matrix_scan() returns 0 when no change, keyboard_task() skips row walk */
+//#define MATRIX_SCAN_CHANGED
+
+/* keep effective layer per key until layer state changes, see action_layer.c */
+//#define LAYER_CACHE_ENABLE
+
+/* resolve effective layer from bitmap of non-transparent layers per key */
+//#define TRANSPARENCY_MAP_ENABLE
+
+/* tapping policy and per-key tapping term, see action_tapping.h */
+//#define TAPPING_POLICY  (TAPPING_PERMISSIVE_HOLD | TAPPING_RETRO_TAP)
+//#define TAPPING_TERM_PER_KEY
+
+/* play macro from keyboard_task() without blocking, see action_macro.h */
+//#define ACTION_MACRO_ASYNC
+
+/* send keyboard report once per loop, see action_util.h */
+//#define REPORT_COALESCE
+
+/* print all reports of scenario */
+//#define BENCH_DUMP
+
+/* virtual milliseconds elapsed per keyboard_task() call */
+#ifndef BENCH_TICK_MS
+#define BENCH_TICK_MS   1
+#endif
+
+/* loops run after last step of scenario to let tapping settle */
+#define BENCH_SETTLE_LOOPS  (TAPPING_TERM * 2 / BENCH_TICK_MS)
+
+
+/*
+ * Feature disable options
+ */
+//#define NO_ACTION_LAYER
+//#define NO_ACTION_TAPPING
+//#define NO_ACTION_ONESHOT
+//#define NO_ACTION_MACRO
+//#define NO_ACTION_FUNCTION
+
+#endif
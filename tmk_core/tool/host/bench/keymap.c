@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include "keycode.h"
+#include "action.h"
+#include "action_code.h"
+#include "action_tapping.h"
+#include "action_macro.h"
+#include "keymap.h"
+
+
+/*
+ * Bench keymap
+ *
+ * Row 0-1 are plain keys, row 2 has modifiers and dual-role keys, layer 1-2
+ * are reached with Fn keys and layer 3-7 are all transparent to make deep
+ * layer stack with TRNS keys.
+ */
+const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [0] = {
+        [0] = { KC_A,    KC_S,    KC_D,    KC_F,    KC_G,    KC_H,    KC_J,    KC_K,    KC_L,    KC_SCLN },
+        [1] = { KC_Q,    KC_W,    KC_E,    KC_R,    KC_T,    KC_Y,    KC_U,    KC_I,    KC_O,    KC_P    },
+        [2] = { KC_LSFT, KC_LCTL, KC_LALT, KC_FN0,  KC_FN1,  KC_FN2,  KC_FN3,  KC_FN4,  KC_RSFT, KC_ENT,  KC_FN5  },
+    },
+    [1] = {
+        [0] = { KC_1,    KC_2,    KC_3,    KC_4,    KC_5,    KC_6,    KC_7,    KC_8,    KC_9,    KC_0    },
+        [1] = { KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS },
+        [2] = { KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS },
+    },
+    [2] = {
+        [0] = { KC_F1,   KC_F2,   KC_F3,   KC_F4,   KC_F5,   KC_F6,   KC_F7,   KC_F8,   KC_F9,   KC_F10  },
+        [1] = { KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS },
+        [2] = { KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS },
+    },
+#define TRNS_ROW    { KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS, KC_TRNS }
+#define TRNS_LAYER  { [0] = TRNS_ROW, [1] = TRNS_ROW, [2] = TRNS_ROW }
+    [3] = TRNS_LAYER,
+    [4] = TRNS_LAYER,
+    [5] = TRNS_LAYER,
+    [6] = TRNS_LAYER,
+    [7] = TRNS_LAYER,
+};
+
+const action_t PROGMEM fn_actions[] = {
+    [0] = ACTION_LAYER_TAP_KEY(1, KC_SPACE),
+    [1] = ACTION_MODS_TAP_KEY(MOD_LCTL, KC_ESC),
+    [2] = ACTION_LAYER_MOMENTARY(2),
+    [3] = ACTION_MODS_TAP_KEY(MOD_LSFT, KC_BSPC),
+    [4] = ACTION_LAYER_TAP_KEY(2, KC_TAB),
+    [5] = ACTION_MACRO(0),
+};
+
+/* types 'hi' with waits */
+const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt)
+{
+    if (record->event.pressed && id == 0) {
+        return MACRO( T(H), W(50), T(I), W(50), END );
+    }
+    return MACRO_NONE;
+}
+
+#ifdef TAPPING_TERM_PER_KEY
+/* shorter term for layer tap keys on thumb */
+uint16_t action_tapping_term(keyevent_t event)
+{
+    if (event.key.row == 2 && (event.key.col == 3 || event.key.col == 7)) {
+        return 120;
+    }
+    return TAPPING_TERM;
+}
+#endif
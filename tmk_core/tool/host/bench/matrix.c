@@ -0,0 +1,62 @@
+/*
+ * Scripted matrix
+ *
+ * Key state is set by bench program with bench_matrix_set() instead of
+ * being read from switches, then goes through debounce as real matrix.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "debounce.h"
+#include "keyboard.h"
+#include "timer.h"
+#include "bench.h"
+
+
+static matrix_row_t matrix[MATRIX_ROWS];
+static matrix_row_t matrix_raw[MATRIX_ROWS];
+
+
+void matrix_init(void)
+{
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) matrix[i] = 0;
+    debounce_init(matrix);
+    bench_matrix_clear();
+}
+
+uint8_t matrix_scan(void)
+{
+#ifdef KEYBOARD_EVENT_QUEUE
+    return 0;
+#endif
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        debounce_row(i, matrix_raw[i]);
+    }
+    return debounce_update();
+}
+
+matrix_row_t matrix_get_row(uint8_t row)
+{
+    return matrix[row];
+}
+
+void bench_matrix_set(uint8_t row, uint8_t col, bool on)
+{
+#ifdef KEYBOARD_EVENT_QUEUE
+    // post event as converter does on receiving make or break code
+    if (on != !!(matrix[row] & ((matrix_row_t)1<<col))) {
+        matrix[row] ^= ((matrix_row_t)1<<col);
+        keyboard_event_post(KEYEVENT(row, col, on));
+    }
+#endif
+    if (on) {
+        matrix_raw[row] |=  ((matrix_row_t)1<<col);
+    } else {
+        matrix_raw[row] &= ~((matrix_row_t)1<<col);
+    }
+}
+
+void bench_matrix_clear(void)
+{
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) matrix_raw[i] = 0;
+}
@@ -0,0 +1,106 @@
+# Host build of tmk_core
+#
+# Builds core with native compiler(gcc/clang) to run key event replays and
+# benchmarks on PC. Timer is virtual(common/host/timer.c) and reports are
+# recorded by protocol/host/record.c instead of being sent over USB.
+# Project provides matrix and keymap as usual.
+
+COMMON_DIR = common
+SRC +=	$(COMMON_DIR)/host.c \
+	$(COMMON_DIR)/keyboard.c \
+	$(COMMON_DIR)/matrix.c \
+	$(COMMON_DIR)/debounce.c \
+	$(COMMON_DIR)/action.c \
+	$(COMMON_DIR)/action_tapping.c \
+	$(COMMON_DIR)/action_macro.c \
+	$(COMMON_DIR)/action_layer.c \
+	$(COMMON_DIR)/action_util.c \
+	$(COMMON_DIR)/print.c \
+	$(COMMON_DIR)/debug.c \
+	$(COMMON_DIR)/util.c \
+	$(COMMON_DIR)/hook.c \
+	$(COMMON_DIR)/host/timer.c \
+	$(COMMON_DIR)/host/suspend.c \
+	$(COMMON_DIR)/host/bootloader.c \
+	protocol/host/record.c
+
+
+# Option modules
+ifeq (yes,$(strip $(UNIMAP_ENABLE)))
+    SRC += $(COMMON_DIR)/unimap.c
+    OPT_DEFS += -DUNIMAP_ENABLE
+    OPT_DEFS += -DACTIONMAP_ENABLE
+else
+    ifeq (yes,$(strip $(ACTIONMAP_ENABLE)))
+	SRC += $(COMMON_DIR)/actionmap.c
+	OPT_DEFS += -DACTIONMAP_ENABLE
+    else
+	SRC += $(COMMON_DIR)/keymap.c
+    endif
+endif
+
+ifeq (yes,$(strip $(MOUSEKEY_ENABLE)))
+    SRC += $(COMMON_DIR)/mousekey.c
+    OPT_DEFS += -DMOUSEKEY_ENABLE
+    OPT_DEFS += -DMOUSE_ENABLE
+endif
+
+ifeq (yes,$(strip $(EXTRAKEY_ENABLE)))
+    OPT_DEFS += -DEXTRAKEY_ENABLE
+endif
+
+ifeq (yes,$(strip $(NKRO_ENABLE)))
+    OPT_DEFS += -DNKRO_ENABLE
+endif
+
+ifeq (yes,$(strip $(USB_6KRO_ENABLE)))
+    OPT_DEFS += -DUSB_6KRO_ENABLE
+endif
+
+# No console on host
+OPT_DEFS += -DNO_PRINT
+OPT_DEFS += -DNO_DEBUG
+
+OPT_DEFS += -DPROTOCOL_HOST
+
+
+# Compiler
+CC = gcc
+OBJDIR = obj_$(TARGET)
+
+CFLAGS += -std=gnu99 -O2 -g -Wall
+CFLAGS += -MMD -MP
+CFLAGS += $(OPT_DEFS)
+ifdef CONFIG_H
+    CFLAGS += -include $(CONFIG_H)
+endif
+
+INCLUDES = -I$(TARGET_DIR) -I$(TMK_DIR)/common -I$(TMK_DIR)/protocol -I$(TMK_DIR)/protocol/host
+
+# Search Path
+VPATH += $(TARGET_DIR)
+VPATH += $(TMK_DIR)
+
+OBJ = $(patsubst %.c,$(OBJDIR)/%.o,$(SRC))
+
+
+all: $(TARGET)
+
+$(TARGET): $(OBJ)
+	$(CC) $(LDFLAGS) -o $@ $^
+
+# You can give extra flags at 'make' command line like: make EXTRAFLAGS=-DFOO=bar
+$(OBJDIR)/%.o: %.c
+	@mkdir -p $(@D)
+	$(CC) -c $(CFLAGS) $(INCLUDES) $(EXTRAFLAGS) -o $@ $<
+
+run: $(TARGET)
+	./$(TARGET)
+
+clean:
+	rm -f $(TARGET)
+	rm -fr $(OBJDIR)
+
+.PHONY: all run clean
+
+-include $(OBJ:.o=.d)
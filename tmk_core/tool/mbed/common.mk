@@ -1,4 +1,5 @@
 OBJECTS += \
+	$(OBJDIR)/common/debounce.o \
 	$(OBJDIR)/common/action.o \
 	$(OBJDIR)/common/action_tapping.o \
 	$(OBJDIR)/common/action_macro.o \